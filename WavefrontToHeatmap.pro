@@ -1,6 +1,6 @@
 #QT -= gui
 
-CONFIG += c++11 console
+CONFIG += c++17 console
 CONFIG -= app_bundle
 
 # The following define makes your compiler emit warnings if you use
@@ -16,7 +16,6 @@ DEFINES += QT_DEPRECATED_WARNINGS
 
 SOURCES += \
         main.cpp \
-    wavefront.cpp
+        allocationcounter.cpp
 
-HEADERS += \
-    wavefront.h
+include(wavefront.pri)
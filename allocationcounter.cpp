@@ -0,0 +1,130 @@
+#include "statistics.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <new>
+
+// Replaces the allocation functions of the program so that heap allocations
+// reach Statistics::countAllocation(). operator new is replaced everywhere;
+// on Linux with glibc malloc and its relatives are as well, which also
+// covers Qt's containers and the aligned forms of new. Sanitizers bring
+// their own malloc, so under them only operator new is counted.
+
+#if defined(__GLIBC__) && !defined(__SANITIZE_ADDRESS__) && !defined(__SANITIZE_THREAD__)
+#define COUNT_MALLOC
+
+extern "C" {
+void *__libc_malloc(size_t Size);
+void *__libc_calloc(size_t Count, size_t Size);
+void *__libc_realloc(void *Pointer, size_t Size);
+void *__libc_memalign(size_t Alignment, size_t Size);
+void __libc_free(void *Pointer);
+
+void *malloc(size_t Size)
+{
+    Statistics::countAllocation();
+    return __libc_malloc(Size);
+}
+
+void *calloc(size_t Count, size_t Size)
+{
+    Statistics::countAllocation();
+    return __libc_calloc(Count, Size);
+}
+
+void *realloc(void *Pointer, size_t Size)
+{
+    Statistics::countAllocation();
+    return __libc_realloc(Pointer, Size);
+}
+
+void *memalign(size_t Alignment, size_t Size)
+{
+    Statistics::countAllocation();
+    return __libc_memalign(Alignment, Size);
+}
+
+void *aligned_alloc(size_t Alignment, size_t Size)
+{
+    Statistics::countAllocation();
+    return __libc_memalign(Alignment, Size);
+}
+
+int posix_memalign(void **Pointer, size_t Alignment, size_t Size)
+{
+    Statistics::countAllocation();
+    void *result = __libc_memalign(Alignment, Size);
+    if(!result)
+        return ENOMEM;
+    *Pointer = result;
+    return 0;
+}
+
+void free(void *Pointer)
+{
+    __libc_free(Pointer);
+}
+}
+#endif
+
+// Without the malloc hooks operator new counts its allocations itself.
+static void *allocate(size_t Size)
+{
+#ifndef COUNT_MALLOC
+    Statistics::countAllocation();
+#endif
+    return std::malloc(Size > 0 ? Size : 1);
+}
+
+void *operator new(size_t Size)
+{
+    void *result = allocate(Size);
+    if(!result)
+        throw std::bad_alloc();
+    return result;
+}
+
+void *operator new[](size_t Size)
+{
+    return operator new(Size);
+}
+
+void *operator new(size_t Size, const std::nothrow_t &) noexcept
+{
+    return allocate(Size);
+}
+
+void *operator new[](size_t Size, const std::nothrow_t &) noexcept
+{
+    return allocate(Size);
+}
+
+void operator delete(void *Pointer) noexcept
+{
+    std::free(Pointer);
+}
+
+void operator delete[](void *Pointer) noexcept
+{
+    std::free(Pointer);
+}
+
+void operator delete(void *Pointer, size_t) noexcept
+{
+    std::free(Pointer);
+}
+
+void operator delete[](void *Pointer, size_t) noexcept
+{
+    std::free(Pointer);
+}
+
+void operator delete(void *Pointer, const std::nothrow_t &) noexcept
+{
+    std::free(Pointer);
+}
+
+void operator delete[](void *Pointer, const std::nothrow_t &) noexcept
+{
+    std::free(Pointer);
+}
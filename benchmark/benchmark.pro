@@ -0,0 +1,21 @@
+#QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = WavefrontToHeatmapBenchmark
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+        main.cpp \
+        meshgenerator.cpp \
+        ../allocationcounter.cpp
+
+HEADERS += \
+        meshgenerator.h
+
+# Peak memory on Windows.
+win32: LIBS += -lpsapi
+
+include(../wavefront.pri)
@@ -0,0 +1,396 @@
+#include <QCoreApplication>
+#include <QString>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QTemporaryFile>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <iostream>
+#include <string>
+#include <cstring>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "wavefront.h"
+#include "meshgenerator.h"
+#include "rasterkernel.h"
+#include "statistics.h"
+
+struct Input {
+    QString wavefrontFilename = QString();
+    MeshGenerator::Kind meshKind = MeshGenerator::Terrain;
+    qint64 faceCount = 1000000;
+    quint64 seed = 1;
+    int scale = 1000;
+    double pixelCount = 4000000;
+    int threads = 1;
+    int parseThreads = 0;
+    Wavefront::RasterMode rasterMode = Wavefront::EdgeFunctionRaster;
+    Wavefront::HeightMode heightMode = Wavefront::PlaneHeight;
+    SpanKernel::Kind kernel = SpanKernel::AutomaticKernel;
+    HeightmapWriter::Format format = HeightmapWriter::Png8Format;
+    int repetitions = 3;
+    QString jsonFilename = QString();
+    QString label = QString();
+    bool isValid = true;
+    bool helpRequested = false;
+};
+
+// The fastest of all repetitions of one stage, and the process's peak
+// memory once the stage has run for the first time.
+struct Stage {
+    QString name;
+    qint64 nanoseconds = -1;
+    qint64 peakMemory = 0;
+
+    double getSeconds() const { return double(nanoseconds)/1e9; }
+    void add(qint64 Elapsed) {
+        if(nanoseconds < 0 || Elapsed < nanoseconds)
+            nanoseconds = Elapsed;
+    }
+};
+
+Input getInputParameters(int argc, char *argv[]) {
+    Input input;
+    for(int i=1; i<argc; i++) {
+        std::string argument = argv[i];
+        if(argument == "-i" && i+1<argc) {
+            input.wavefrontFilename = argv[++i];
+        }
+        else if(argument == "-g" && i+1<argc) {
+            input.meshKind = MeshGenerator::getKind(argv[++i]);
+            input.isValid = input.isValid && input.meshKind != MeshGenerator::Unknown;
+        }
+        else if(argument == "-n" && i+1<argc) {
+            input.faceCount = QString(argv[++i]).toLongLong();
+        }
+        else if(argument == "--seed" && i+1<argc) {
+            input.seed = quint64(QString(argv[++i]).toLongLong());
+        }
+        else if(argument == "-s" && i+1<argc) {
+            input.scale = QString(argv[++i]).toInt();
+        }
+        else if(argument == "-c" && i+1<argc) {
+            input.pixelCount = QString(argv[++i]).toDouble();
+        }
+        else if(argument == "-j" && i+1<argc) {
+            input.threads = QString(argv[++i]).toInt();
+        }
+        else if(argument == "--parse-threads" && i+1<argc) {
+            input.parseThreads = QString(argv[++i]).toInt();
+        }
+        else if(argument == "-m" && i+1<argc) {
+            std::string mode = argv[++i];
+            if(mode == "crossing")
+                input.rasterMode = Wavefront::CrossingTestRaster;
+            else if(mode == "edge")
+                input.rasterMode = Wavefront::EdgeFunctionRaster;
+            else
+                input.isValid = false;
+        }
+        else if(argument == "--heights" && i+1<argc) {
+            std::string mode = argv[++i];
+            if(mode == "plane")
+                input.heightMode = Wavefront::PlaneHeight;
+            else if(mode == "stepped")
+                input.heightMode = Wavefront::RowSteppedHeight;
+            else
+                input.isValid = false;
+        }
+        else if(argument == "--kernel" && i+1<argc) {
+            input.kernel = SpanKernel::getKind(argv[++i]);
+            input.isValid = input.isValid && input.kernel != SpanKernel::UnknownKernel;
+        }
+        else if(argument == "--format" && i+1<argc) {
+            input.format = HeightmapWriter::getFormat(argv[++i]);
+            input.isValid = input.isValid && input.format != HeightmapWriter::UnknownFormat;
+        }
+        else if(argument == "-r" && i+1<argc) {
+            input.repetitions = QString(argv[++i]).toInt();
+        }
+        else if(argument == "--json" && i+1<argc) {
+            input.jsonFilename = argv[++i];
+        }
+        else if(argument == "--label" && i+1<argc) {
+            input.label = argv[++i];
+        }
+        else if(argument == "-h") {
+            input.helpRequested = true;
+        }
+        else {
+            input.isValid = false;
+        }
+    }
+    input.isValid = input.isValid && input.faceCount > 0 && input.scale > 0 && input.pixelCount > 0 &&
+            input.threads >= 0 && input.parseThreads >= 0 && input.repetitions > 0;
+    return input;
+}
+
+void displayHelp() {
+    std::cout << "Usage of WavefrontToHeatmapBenchmark:" << std::endl;
+    std::cout << "Times parsing, rasterizing and encoding on a synthetic mesh or a scaled-up obj file." << std::endl;
+    std::cout << "-g <Mesh>" << "\t" << "Synthetic mesh: terrain, soup or sliver. Default terrain." << std::endl;
+    std::cout << "-n <Faces>" << "\t" << "Approximate face count of the synthetic mesh. Default 1000000." << std::endl;
+    std::cout << "--seed <Seed>" << "\t" << "Seed of the synthetic mesh. Default 1." << std::endl;
+    std::cout << "-i <InputFile>" << "\t" << "Obj file to scale up instead, e.g. example/Monkey.obj." << std::endl;
+    std::cout << "-s <Scale>" << "\t" << "Number of copies of the input file. Default 1000." << std::endl;
+    std::cout << "-c <PixelCount>" << "\t" << "Approximate pixel count of the heatmap. Default 4000000." << std::endl;
+    std::cout << "-j <Threads>" << "\t" << "Render threads, 0 uses one per core. Default 1." << std::endl;
+    std::cout << "--parse-threads <Threads>" << "\t" << "Threads parsing the obj file, 0 uses one per core. Default 0." << std::endl;
+    std::cout << "-m <Mode>" << "\t" << "Raster mode, edge or crossing. Default edge." << std::endl;
+    std::cout << "--heights <Mode>" << "\t" << "Span start heights, plane or stepped. Default plane." << std::endl;
+    std::cout << "--kernel <Kernel>" << "\t" << "Span kernel of the edge rasterizer: auto, scalar, avx2 or avx512. Default auto. "
+                 "Any other than scalar is checked against the scalar one." << std::endl;
+    std::cout << "--format <Format>" << "\t" << "Encoded format: png, png16, f32 or npy. Default png." << std::endl;
+    std::cout << "-r <Repetitions>" << "\t" << "Number of timed runs per stage, the fastest one is reported. Default 3." << std::endl;
+    std::cout << "--json <File>" << "\t" << "Also write the results as JSON, - for stdout." << std::endl;
+    std::cout << "--label <Label>" << "\t" << "Free text stored in the JSON, e.g. the version under test." << std::endl;
+}
+
+// Peak resident set size of the process in bytes.
+qint64 getPeakMemory() {
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+    if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return qint64(counters.PeakWorkingSetSize);
+#else
+    struct rusage usage;
+    if(getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef Q_OS_MACOS
+    return qint64(usage.ru_maxrss);
+#else
+    return qint64(usage.ru_maxrss)*1024;
+#endif
+#endif
+}
+
+double getRate(double Amount, const Stage &stage) {
+    return stage.nanoseconds > 0 ? Amount/stage.getSeconds() : 0.;
+}
+
+void outputStage(const Stage &stage, QString Rates) {
+    std::cout << stage.name.toStdString() << ": " << stage.getSeconds() << " s. " << Rates.toStdString() <<
+                 " Peak memory: " << double(stage.peakMemory)/(1024.*1024.) << " MB." << std::endl;
+}
+
+// Whether two renders hold the same bits in every pixel.
+bool isIdentical(Grid &A, Grid &B) {
+    if(A.getWindowWidth() != B.getWindowWidth() || A.getWindowHeight() != B.getWindowHeight())
+        return false;
+    size_t rowSize = size_t(A.getWindowWidth())*sizeof(double);
+    for(int j=A.getWindowMinimum().j; j<=A.getWindowMaximum().j; j++) {
+        if(memcmp(A.getRow(j), B.getRow(j - A.getWindowMinimum().j + B.getWindowMinimum().j), rowSize) != 0)
+            return false;
+    }
+    return true;
+}
+
+QJsonObject getStageJson(const Stage &stage) {
+    QJsonObject object;
+    object.insert("seconds", stage.getSeconds());
+    object.insert("peakMemoryBytes", stage.peakMemory);
+    return object;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    Input input = getInputParameters(argc, argv);
+    if(input.helpRequested || !input.isValid) {
+        displayHelp();
+        return input.helpRequested ? 0 : 1;
+    }
+    if(!SpanKernel::select(input.kernel)) {
+        std::cout << "This processor does not support the " << SpanKernel::getName(input.kernel).toStdString() <<
+                     " kernel." << std::endl;
+        return 1;
+    }
+    SpanKernel::Kind kernel = SpanKernel::getKind();
+
+    QTemporaryFile mesh(QDir::tempPath() + "/WavefrontToHeatmapBenchmark-XXXXXX.obj");
+    bool isWritten = mesh.open();
+    QString source;
+    if(input.wavefrontFilename.isEmpty()) {
+        MeshGenerator generator(input.meshKind, input.faceCount, input.seed);
+        isWritten = isWritten && generator.write(mesh);
+        source = MeshGenerator::getName(input.meshKind);
+    }
+    else {
+        isWritten = isWritten && MeshGenerator::writeScaled(input.wavefrontFilename, input.scale, mesh);
+        source = input.wavefrontFilename;
+    }
+    mesh.close();
+    if(!isWritten) {
+        std::cout << "Could not write the benchmark obj file." << std::endl;
+        return 1;
+    }
+    qint64 bytes = QFileInfo(mesh.fileName()).size();
+    double megabytes = double(bytes)/(1024.*1024.);
+    std::cout << "Mesh: " << source.toStdString() << " (" << megabytes << " MB)." << std::endl;
+
+    Stage parse, rasterize, encode;
+    parse.name = "Parse";
+    rasterize.name = "Rasterize";
+    encode.name = "Encode";
+
+    QScopedPointer<Wavefront> wavefront;
+    for(int i=0; i<input.repetitions; i++) {
+        wavefront.reset();
+        QElapsedTimer timer;
+        timer.start();
+        wavefront.reset(new Wavefront(mesh.fileName(), false, false, QString(), input.parseThreads));
+        parse.add(timer.nsecsElapsed());
+        if(i == 0)
+            parse.peakMemory = getPeakMemory();
+    }
+    wavefront->setRasterMode(input.rasterMode);
+    wavefront->setHeightMode(input.heightMode);
+    wavefront->setThreadCount(input.threads);
+    qint64 faces = wavefront->getFaceCount();
+    double precision = wavefront->getPrecision(qint64(input.pixelCount));
+    if(faces == 0 || !(precision > 0.)) {
+        std::cout << "The mesh has no faces." << std::endl;
+        return 1;
+    }
+
+    Grid grid = Grid(Coordinate2D(0., 0.), Coordinate2D(0., 0.), 1., false);
+    for(int i=0; i<input.repetitions; i++) {
+        grid = Grid(Coordinate2D(0., 0.), Coordinate2D(0., 0.), 1., false);
+        QElapsedTimer timer;
+        timer.start();
+        grid = wavefront->getHeatmap(precision);
+        rasterize.add(timer.nsecsElapsed());
+        if(i == 0)
+            rasterize.peakMemory = getPeakMemory();
+    }
+    qint64 pixels = qint64(grid.getWindowWidth())*grid.getWindowHeight();
+
+    // One more render counts the heap allocations of its face loops, which
+    // should be none.
+    Statistics::reset();
+    Statistics::setEnabled(true);
+    wavefront->getHeatmap(precision);
+    Statistics::setEnabled(false);
+    qint64 loopAllocations = Statistics::getCount(Statistics::AllocationsCounter);
+    Statistics::reset();
+
+    bool isKernelChecked = kernel != SpanKernel::ScalarKernel && input.rasterMode == Wavefront::EdgeFunctionRaster;
+    bool isKernelIdentical = true;
+    if(isKernelChecked) {
+        SpanKernel::select(SpanKernel::ScalarKernel);
+        Grid reference = wavefront->getHeatmap(precision);
+        SpanKernel::select(kernel);
+        isKernelIdentical = isIdentical(grid, reference);
+    }
+
+    QString suffix = HeightmapWriter::getSuffix(input.format);
+    QTemporaryFile output(QDir::tempPath() + "/WavefrontToHeatmapBenchmark-XXXXXX." + suffix);
+    if(!output.open()) {
+        std::cout << "Could not create the benchmark output file." << std::endl;
+        return 1;
+    }
+    output.close();
+    qint64 outputBytes = 0;
+    for(int i=0; i<input.repetitions; i++) {
+        QElapsedTimer timer;
+        timer.start();
+        if(!wavefront->saveHeatmap(grid, output.fileName(), input.format)) {
+            std::cout << "Could not write the benchmark output file." << std::endl;
+            return 1;
+        }
+        encode.add(timer.nsecsElapsed());
+        if(i == 0)
+            encode.peakMemory = getPeakMemory();
+        outputBytes = QFileInfo(output.fileName()).size();
+    }
+    // The raw float format writes a header next to the image.
+    QFileInfo outputInfo(output.fileName());
+    QFile::remove(outputInfo.path() + "/" + outputInfo.completeBaseName() + ".hdr");
+
+    std::cout << "Faces: " << faces << ". Pixels: " << pixels << " (" << grid.getWindowWidth() << "x" <<
+                 grid.getWindowHeight() << "). Threads: " << input.threads <<
+                 ", parsing on " << input.parseThreads << "." << std::endl;
+    std::cout << "Kernel: " << SpanKernel::getName(kernel).toStdString();
+    if(isKernelChecked)
+        std::cout << (isKernelIdentical ? ", identical to scalar." : ", DIFFERS FROM SCALAR.");
+    std::cout << std::endl;
+    std::cout << "Allocations in the raster loop: " << loopAllocations << "." << std::endl;
+    outputStage(parse, QString("%1 MB/s, %2 faces/s.").arg(getRate(megabytes, parse))
+                .arg(getRate(double(faces), parse)));
+    outputStage(rasterize, QString("%1 pixels/s, %2 faces/s.").arg(getRate(double(pixels), rasterize))
+                .arg(getRate(double(faces), rasterize)));
+    outputStage(encode, QString("%1 pixels/s, %2 MB/s written.").arg(getRate(double(pixels), encode))
+                .arg(getRate(double(outputBytes)/(1024.*1024.), encode)));
+
+    int exitCode = isKernelIdentical && loopAllocations == 0 ? 0 : 1;
+    if(input.jsonFilename.isEmpty())
+        return exitCode;
+
+    QJsonObject meshJson;
+    meshJson.insert("source", source);
+    meshJson.insert("seed", qint64(input.seed));
+    meshJson.insert("faces", faces);
+    meshJson.insert("bytes", bytes);
+
+    QJsonObject settings;
+    settings.insert("pixelCount", input.pixelCount);
+    settings.insert("pixels", pixels);
+    settings.insert("width", grid.getWindowWidth());
+    settings.insert("height", grid.getWindowHeight());
+    settings.insert("threads", input.threads);
+    settings.insert("parseThreads", input.parseThreads);
+    settings.insert("rasterMode", input.rasterMode == Wavefront::CrossingTestRaster ? "crossing" : "edge");
+    settings.insert("heights", input.heightMode == Wavefront::RowSteppedHeight ? "stepped" : "plane");
+    settings.insert("kernel", SpanKernel::getName(kernel));
+    settings.insert("format", suffix);
+    settings.insert("repetitions", input.repetitions);
+
+    QJsonObject parseJson = getStageJson(parse);
+    parseJson.insert("megabytesPerSecond", getRate(megabytes, parse));
+    parseJson.insert("facesPerSecond", getRate(double(faces), parse));
+    QJsonObject rasterizeJson = getStageJson(rasterize);
+    rasterizeJson.insert("pixelsPerSecond", getRate(double(pixels), rasterize));
+    rasterizeJson.insert("facesPerSecond", getRate(double(faces), rasterize));
+    QJsonObject encodeJson = getStageJson(encode);
+    encodeJson.insert("pixelsPerSecond", getRate(double(pixels), encode));
+    encodeJson.insert("bytes", outputBytes);
+
+    QJsonObject stages;
+    stages.insert("parse", parseJson);
+    stages.insert("rasterize", rasterizeJson);
+    stages.insert("encode", encodeJson);
+
+    QJsonObject result;
+    result.insert("label", input.label);
+    result.insert("mesh", meshJson);
+    result.insert("settings", settings);
+    result.insert("stages", stages);
+    if(isKernelChecked)
+        result.insert("kernelIdenticalToScalar", isKernelIdentical);
+    result.insert("rasterLoopAllocations", loopAllocations);
+    result.insert("peakMemoryBytes", getPeakMemory());
+
+    QByteArray json = QJsonDocument(result).toJson();
+    if(input.jsonFilename == "-") {
+        std::cout << json.constData();
+        return exitCode;
+    }
+    QFile file(input.jsonFilename);
+    if(!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+        std::cout << "Could not write " << input.jsonFilename.toStdString() << "." << std::endl;
+        return 1;
+    }
+    file.close();
+    return exitCode;
+}
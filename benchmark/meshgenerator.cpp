@@ -0,0 +1,300 @@
+#include "meshgenerator.h"
+
+#include <QList>
+#include <QtMath>
+
+// Side length of the square all generated meshes cover.
+static const double meshSize = 1000.;
+
+MeshGenerator::MeshGenerator(Kind MeshKind, qint64 FaceCount, quint64 Seed)
+{
+    kind = MeshKind;
+    faceCount = FaceCount;
+    state = Seed;
+    vertexCount = 0;
+    normalCount = 0;
+}
+
+MeshGenerator::Kind MeshGenerator::getKind(QString Name)
+{
+    Name = Name.toLower();
+    if(Name == "terrain")
+        return Terrain;
+    if(Name == "soup")
+        return Soup;
+    if(Name == "sliver")
+        return Sliver;
+    return Unknown;
+}
+
+QString MeshGenerator::getName(Kind MeshKind)
+{
+    switch(MeshKind) {
+    case Terrain:
+        return "terrain";
+    case Soup:
+        return "soup";
+    case Sliver:
+        return "sliver";
+    default:
+        return QString();
+    }
+}
+
+bool MeshGenerator::write(QFile &Target)
+{
+    buffer.clear();
+    vertexCount = 0;
+    normalCount = 0;
+    buffer.reserve(bufferSize + 256);
+    bool isWritten = false;
+    if(kind == Terrain)
+        isWritten = writeTerrain(Target);
+    else if(kind == Soup)
+        isWritten = writeSoup(Target);
+    else if(kind == Sliver)
+        isWritten = writeSliver(Target);
+    return isWritten && flush(Target, true);
+}
+
+// An n x n cell height field of waves. Every object is a strip of rows with
+// its own copy of the boundary vertices, so that no face refers to another
+// object's vertices.
+bool MeshGenerator::writeTerrain(QFile &Target)
+{
+    int cells = qMax(1, qCeil(qSqrt(double(faceCount)/2.)));
+    int rowsPerObject = qMax(1, facesPerObject/(2*cells));
+    double step = meshSize/cells;
+    for(int firstRow=0; firstRow<cells; firstRow+=rowsPerObject) {
+        int rows = qMin(rowsPerObject, cells - firstRow);
+        appendObject("Terrain_" + QString::number(firstRow/rowsPerObject));
+        qint64 firstVertex = vertexCount;
+        for(int j=firstRow; j<=firstRow+rows; j++) {
+            for(int i=0; i<=cells; i++)
+                appendVertex(i*step, j*step, getTerrainHeight(i*step, j*step));
+        }
+        for(int j=firstRow; j<firstRow+rows; j++) {
+            for(int i=0; i<cells; i++) {
+                qint64 bottomLeft = firstVertex + qint64(j - firstRow)*(cells + 1) + i + 1;
+                qint64 topLeft = bottomLeft + cells + 1;
+                Coordinate3D corners[4] = {
+                    Coordinate3D(i*step, j*step, getTerrainHeight(i*step, j*step)),
+                    Coordinate3D((i+1)*step, j*step, getTerrainHeight((i+1)*step, j*step)),
+                    Coordinate3D((i+1)*step, (j+1)*step, getTerrainHeight((i+1)*step, (j+1)*step)),
+                    Coordinate3D(i*step, (j+1)*step, getTerrainHeight(i*step, (j+1)*step))
+                };
+                appendNormal(corners[0], corners[1], corners[2]);
+                appendFace(bottomLeft, bottomLeft + 1, topLeft + 1, normalCount);
+                appendNormal(corners[0], corners[2], corners[3]);
+                appendFace(bottomLeft, topLeft + 1, topLeft, normalCount);
+            }
+            if(!flush(Target, false))
+                return false;
+        }
+    }
+    return true;
+}
+
+// Triangles with corners around random centers. Their size is chosen so that
+// the whole square is covered about twice.
+bool MeshGenerator::writeSoup(QFile &Target)
+{
+    double radius = 2.5*meshSize/qSqrt(double(qMax<qint64>(faceCount, 1)));
+    for(qint64 i=0; i<faceCount; i++) {
+        if(i%facesPerObject == 0)
+            appendObject("Soup_" + QString::number(i/facesPerObject));
+        double centerX = getRandom()*meshSize;
+        double centerY = getRandom()*meshSize;
+        Coordinate3D corners[3];
+        for(int k=0; k<3; k++) {
+            corners[k].x = centerX + (2.*getRandom() - 1.)*radius;
+            corners[k].y = centerY + (2.*getRandom() - 1.)*radius;
+            corners[k].z = getRandom()*100.;
+        }
+        appendTriangle(corners);
+        if(!flush(Target, false))
+            return false;
+    }
+    return true;
+}
+
+// Needles an eighth of the square long and a thousandth of that wide, in
+// random directions. They cover few pixels of large bounding boxes.
+bool MeshGenerator::writeSliver(QFile &Target)
+{
+    double length = meshSize/8.;
+    double width = length/1000.;
+    for(qint64 i=0; i<faceCount; i++) {
+        if(i%facesPerObject == 0)
+            appendObject("Sliver_" + QString::number(i/facesPerObject));
+        double centerX = getRandom()*meshSize;
+        double centerY = getRandom()*meshSize;
+        double angle = getRandom()*2.*M_PI;
+        double directionX = qCos(angle);
+        double directionY = qSin(angle);
+        Coordinate3D corners[3] = {
+            Coordinate3D(centerX - directionX*length/2., centerY - directionY*length/2., getRandom()*100.),
+            Coordinate3D(centerX + directionX*length/2., centerY + directionY*length/2., getRandom()*100.),
+            Coordinate3D(centerX - directionY*width, centerY + directionX*width, getRandom()*100.)
+        };
+        appendTriangle(corners);
+        if(!flush(Target, false))
+            return false;
+    }
+    return true;
+}
+
+void MeshGenerator::appendVertex(double X, double Y, double Z)
+{
+    buffer.append("v ");
+    buffer.append(QByteArray::number(X, 'f', 6));
+    buffer.append(' ');
+    buffer.append(QByteArray::number(Y, 'f', 6));
+    buffer.append(' ');
+    buffer.append(QByteArray::number(Z, 'f', 6));
+    buffer.append('\n');
+    vertexCount++;
+}
+
+void MeshGenerator::appendNormal(Coordinate3D A, Coordinate3D B, Coordinate3D C)
+{
+    double x = (B.y-A.y)*(C.z-A.z) - (B.z-A.z)*(C.y-A.y);
+    double y = (B.z-A.z)*(C.x-A.x) - (B.x-A.x)*(C.z-A.z);
+    double z = (B.x-A.x)*(C.y-A.y) - (B.y-A.y)*(C.x-A.x);
+    double length = qSqrt(x*x + y*y + z*z);
+    if(length > 0.) {
+        x /= length;
+        y /= length;
+        z /= length;
+    }
+    buffer.append("vn ");
+    buffer.append(QByteArray::number(x, 'f', 6));
+    buffer.append(' ');
+    buffer.append(QByteArray::number(y, 'f', 6));
+    buffer.append(' ');
+    buffer.append(QByteArray::number(z, 'f', 6));
+    buffer.append('\n');
+    normalCount++;
+}
+
+// A, B and C are 1-based global vertex indices, Normal a 1-based normal index.
+void MeshGenerator::appendFace(qint64 A, qint64 B, qint64 C, qint64 Normal)
+{
+    QByteArray normal = "//" + QByteArray::number(Normal);
+    buffer.append("f ");
+    buffer.append(QByteArray::number(A) + normal);
+    buffer.append(' ');
+    buffer.append(QByteArray::number(B) + normal);
+    buffer.append(' ');
+    buffer.append(QByteArray::number(C) + normal);
+    buffer.append('\n');
+}
+
+void MeshGenerator::appendTriangle(Coordinate3D Corners[3])
+{
+    for(int k=0; k<3; k++)
+        appendVertex(Corners[k].x, Corners[k].y, Corners[k].z);
+    appendNormal(Corners[0], Corners[1], Corners[2]);
+    appendFace(vertexCount - 2, vertexCount - 1, vertexCount, normalCount);
+}
+
+double MeshGenerator::getTerrainHeight(double X, double Y)
+{
+    return 20.*qSin(X*0.02)*qCos(Y*0.015) + 5.*qSin(X*0.11 + Y*0.07) + 0.5*qSin(X*1.3)*qSin(Y*1.7);
+}
+
+void MeshGenerator::appendObject(QString Name)
+{
+    buffer.append("o ");
+    buffer.append(Name.toUtf8());
+    buffer.append('\n');
+}
+
+bool MeshGenerator::flush(QFile &Target, bool Force)
+{
+    if(buffer.size() < bufferSize && !Force)
+        return true;
+    bool isWritten = Target.write(buffer) == buffer.size();
+    buffer.clear();
+    return isWritten;
+}
+
+double MeshGenerator::getRandom()
+{
+    state = state*6364136223846793005ULL + 1442695040888963407ULL;
+    return double(state >> 11)/9007199254740992.;
+}
+
+// Shifts the 1-based indices of an "f" line by the given v, vt and vn
+// offsets. Negative indices are relative and stay as they are.
+QByteArray MeshGenerator::shiftFaceIndices(const QByteArray &Line, const int Offsets[3])
+{
+    QByteArray shifted = "f";
+    int position = 1;
+    while(position < Line.size()) {
+        while(position < Line.size() && Line[position] == ' ')
+            position++;
+        int end = position;
+        while(end < Line.size() && Line[end] != ' ')
+            end++;
+        if(end == position)
+            break;
+        QByteArray token = Line.mid(position, end - position);
+        QByteArray shiftedToken;
+        int component = 0;
+        int start = 0;
+        for(int k=0; k<=token.size(); k++) {
+            if(k == token.size() || token[k] == '/') {
+                QByteArray number = token.mid(start, k - start);
+                if(!number.isEmpty()) {
+                    int index = number.toInt();
+                    shiftedToken.append(QByteArray::number(index > 0 ? index + Offsets[qMin(component, 2)] : index));
+                }
+                if(k < token.size())
+                    shiftedToken.append('/');
+                component++;
+                start = k + 1;
+            }
+        }
+        shifted.append(' ');
+        shifted.append(shiftedToken);
+        position = end;
+    }
+    return shifted;
+}
+
+bool MeshGenerator::writeScaled(QString Source, int Scale, QFile &Target)
+{
+    QFile file(Source);
+    if(!file.open(QIODevice::ReadOnly))
+        return false;
+    QList<QByteArray> lines = file.readAll().split('\n');
+    file.close();
+
+    int counts[3] = {0, 0, 0};
+    for(int i=0; i<lines.size(); i++) {
+        if(lines[i].startsWith("v "))
+            counts[0]++;
+        else if(lines[i].startsWith("vt "))
+            counts[1]++;
+        else if(lines[i].startsWith("vn "))
+            counts[2]++;
+    }
+
+    for(int copy=0; copy<Scale; copy++) {
+        int offsets[3] = {copy*counts[0], copy*counts[1], copy*counts[2]};
+        QByteArray chunk;
+        for(int i=0; i<lines.size(); i++) {
+            if(lines[i].startsWith("o "))
+                chunk.append(lines[i].trimmed() + "_" + QByteArray::number(copy));
+            else if(lines[i].startsWith("f "))
+                chunk.append(shiftFaceIndices(lines[i].trimmed(), offsets));
+            else
+                chunk.append(lines[i]);
+            chunk.append('\n');
+        }
+        if(Target.write(chunk) != chunk.size())
+            return false;
+    }
+    return true;
+}
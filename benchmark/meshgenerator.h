@@ -0,0 +1,65 @@
+#ifndef MESHGENERATOR_H
+#define MESHGENERATOR_H
+
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+
+#include "wavefront.h"
+
+// Writes synthetic obj files of a given size for the benchmark. The meshes
+// only depend on the face count and the seed, on every platform, so timings
+// of different versions are taken on the same input.
+class MeshGenerator
+{
+public:
+    enum Kind {
+        Terrain, // Regular height field, two triangles per grid cell.
+        Soup,    // Independent random triangles, overlapping a few layers deep.
+        Sliver,  // Long needle-thin triangles with large, mostly empty bounding boxes.
+        Unknown
+    };
+
+    MeshGenerator(Kind MeshKind, qint64 FaceCount, quint64 Seed = 1);
+
+    static Kind getKind(QString Name);
+    static QString getName(Kind MeshKind);
+
+    bool write(QFile &Target);
+    // Scale copies of Source, each with its own object names and shifted
+    // face indices, so the result parses like one large mesh.
+    static bool writeScaled(QString Source, int Scale, QFile &Target);
+
+private:
+    bool writeTerrain(QFile &Target);
+    bool writeSoup(QFile &Target);
+    bool writeSliver(QFile &Target);
+
+    void appendVertex(double X, double Y, double Z);
+    // Exported meshes usually carry a normal per face, so the generated
+    // ones do too.
+    void appendNormal(Coordinate3D A, Coordinate3D B, Coordinate3D C);
+    void appendFace(qint64 A, qint64 B, qint64 C, qint64 Normal);
+    void appendTriangle(Coordinate3D Corners[3]);
+
+    static double getTerrainHeight(double X, double Y);
+    void appendObject(QString Name);
+    bool flush(QFile &Target, bool Force);
+
+    // 53 random bits from a 64 bit LCG, in [0, 1).
+    double getRandom();
+
+    static QByteArray shiftFaceIndices(const QByteArray &Line, const int Offsets[3]);
+
+    Kind kind;
+    qint64 faceCount;
+    quint64 state;
+    qint64 vertexCount;
+    qint64 normalCount;
+    QByteArray buffer;
+
+    static const int facesPerObject = 100000;
+    static const int bufferSize = 1 << 20;
+};
+
+#endif // MESHGENERATOR_H
@@ -0,0 +1,164 @@
+#include "heatmapjob.h"
+
+#include <QFile>
+
+HeatmapJob::HeatmapJob()
+{
+    precision = 0.;
+    pixelCount = 0;
+    format = HeightmapWriter::Png8Format;
+    hasCrop = false;
+    maxMemory = 0;
+    isWritten = false;
+}
+
+bool HeatmapJob::readManifest(QString Filename, HeatmapJob Defaults, QVector<HeatmapJob> &Jobs, QString &Error)
+{
+    QFile file(Filename);
+    if(!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        Error = QString("Could not open %1.").arg(Filename);
+        return false;
+    }
+
+    int lineNumber = 0;
+    while(!file.atEnd()) {
+        lineNumber++;
+        QString line = QString::fromUtf8(file.readLine()).trimmed();
+        if(line.isEmpty() || line.startsWith("#"))
+            continue;
+
+        QStringList tokens;
+        QStringList parts = line.split(" ");
+        for(int i=0; i<parts.size(); i++) {
+            QString part = parts[i].trimmed();
+            if(!part.isEmpty())
+                tokens.append(part);
+        }
+
+        // --format goes last, so that it wins over the extension given to -o.
+        HeatmapJob job = Defaults;
+        bool isValid = tokens.size()%2 == 0;
+        for(int pass=0; pass<2 && isValid; pass++) {
+            for(int i=0; i+1<tokens.size() && isValid; i+=2) {
+                if((tokens[i] == "--format") == (pass == 1))
+                    isValid = job.setOption(tokens[i], tokens[i+1]);
+            }
+        }
+        if(!isValid) {
+            Error = QString("Invalid job in line %1 of %2.").arg(lineNumber).arg(Filename);
+            return false;
+        }
+        if(!(job.precision > 0.) && job.pixelCount <= 0) {
+            Error = QString("Line %1 of %2 sets neither -c nor -p.").arg(lineNumber).arg(Filename);
+            return false;
+        }
+        if(job.hasCrop && job.maxMemory > 0) {
+            Error = QString("A crop can not be combined with a memory limit, line %1 of %2.").arg(lineNumber).arg(Filename);
+            return false;
+        }
+        Jobs.append(job);
+    }
+    return true;
+}
+
+bool HeatmapJob::isOption(QString Option)
+{
+    return Option == "-c" || Option == "-p" || Option == "-o" || Option == "--format" ||
+            Option == "--crop" || Option == "--max-memory";
+}
+
+bool HeatmapJob::setOption(QString Option, QString Value)
+{
+    bool isValid = false;
+    if(Option == "-c") {
+        double count = Value.toDouble(&isValid);
+        isValid = isValid && count >= 1.;
+        if(isValid) {
+            pixelCount = qint64(count);
+            precision = 0.;
+        }
+    }
+    else if(Option == "-p") {
+        double value = Value.toDouble(&isValid);
+        isValid = isValid && value > 0.;
+        if(isValid) {
+            precision = value;
+            pixelCount = 0;
+        }
+    }
+    else if(Option == "-o") {
+        isValid = !Value.isEmpty();
+        outputFilename = Value;
+        HeightmapWriter::Format type = HeightmapWriter::getFormatFromFilename(Value);
+        if(type != HeightmapWriter::UnknownFormat)
+            format = type;
+    }
+    else if(Option == "--format") {
+        format = HeightmapWriter::getFormat(Value);
+        isValid = format != HeightmapWriter::UnknownFormat;
+    }
+    else if(Option == "--crop") {
+        isValid = parseRectangle(Value, cropMinimum, cropMaximum);
+        hasCrop = isValid;
+    }
+    else if(Option == "--max-memory") {
+        isValid = parseMemorySize(Value, maxMemory);
+    }
+    return isValid;
+}
+
+bool HeatmapJob::parseMemorySize(QString Text, qint64 &Size)
+{
+    QString number = Text.trimmed().toUpper();
+    qint64 factor = 1;
+    if(number.endsWith("B"))
+        number.chop(1);
+    if(number.endsWith("K"))
+        factor = qint64(1) << 10;
+    else if(number.endsWith("M"))
+        factor = qint64(1) << 20;
+    else if(number.endsWith("G"))
+        factor = qint64(1) << 30;
+    else if(number.endsWith("T"))
+        factor = qint64(1) << 40;
+    if(factor > 1)
+        number.chop(1);
+    bool isValid = false;
+    double size = number.toDouble(&isValid);
+    if(!isValid || !(size > 0.))
+        return false;
+    Size = qint64(size*double(factor));
+    return true;
+}
+
+bool HeatmapJob::parseRectangle(QString Text, Coordinate2D &Minimum, Coordinate2D &Maximum)
+{
+    QStringList values = Text.split(",");
+    if(values.size() != 4)
+        return false;
+    double bounds[4];
+    for(int k=0; k<4; k++) {
+        bool isValid = false;
+        bounds[k] = values[k].toDouble(&isValid);
+        if(!isValid)
+            return false;
+    }
+    if(bounds[0] > bounds[2] || bounds[1] > bounds[3])
+        return false;
+    Minimum = Coordinate2D(bounds[0], bounds[1]);
+    Maximum = Coordinate2D(bounds[2], bounds[3]);
+    return true;
+}
+
+HeatmapJobTask::HeatmapJobTask(Wavefront *Owner, HeatmapJob *Job, int Threads)
+{
+    owner = Owner;
+    job = Job;
+    threads = Threads;
+    setAutoDelete(false);
+}
+
+void HeatmapJobTask::run()
+{
+    job->isWritten = owner->renderJob(*job, threads);
+}
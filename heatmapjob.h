@@ -0,0 +1,59 @@
+#ifndef HEATMAPJOB_H
+#define HEATMAPJOB_H
+
+#include <QString>
+#include <QVector>
+#include <QStringList>
+#include <QRunnable>
+
+#include "wavefront.h"
+
+// One output of Wavefront::renderBatch: resolution, area, target file and
+// format. Either precision or pixelCount sets the resolution.
+class HeatmapJob
+{
+public:
+    HeatmapJob();
+
+    double precision;   // Pixel pitch, 0 to derive it from pixelCount.
+    qint64 pixelCount;  // Approximate pixel count of the whole mesh.
+    QString outputFilename;
+    HeightmapWriter::Format format;
+    bool hasCrop;
+    Coordinate2D cropMinimum, cropMaximum;
+    qint64 maxMemory;   // Render in bands below this many bytes, 0 renders in memory. Not with a crop.
+
+    bool isWritten;     // Set by renderBatch.
+
+    // A job manifest has one job per line, written with the command line's
+    // job options: -c, -p, -o, --format, --crop and --max-memory. Empty lines
+    // and lines starting with # are skipped. Every job starts out as a copy
+    // of Defaults. On failure Error names the offending line.
+    static bool readManifest(QString Filename, HeatmapJob Defaults, QVector<HeatmapJob> &Jobs, QString &Error);
+    // Applies one job option with its value, returns false if Option is no
+    // job option or Value is invalid.
+    bool setOption(QString Option, QString Value);
+    static bool isOption(QString Option);
+
+    // Sizes like 512M or 2G (powers of 1024), plain numbers are bytes.
+    static bool parseMemorySize(QString Text, qint64 &Size);
+    // MinX,MinY,MaxX,MaxY
+    static bool parseRectangle(QString Text, Coordinate2D &Minimum, Coordinate2D &Maximum);
+};
+
+
+// Runs one job of a batch on the batch's thread pool.
+class HeatmapJobTask : public QRunnable
+{
+public:
+    HeatmapJobTask(Wavefront *Owner, HeatmapJob *Job, int Threads);
+
+    void run();
+
+private:
+    Wavefront *owner;
+    HeatmapJob *job;
+    int threads;
+};
+
+#endif // HEATMAPJOB_H
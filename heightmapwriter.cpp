@@ -0,0 +1,298 @@
+#include "heightmapwriter.h"
+#include "wavefront.h"
+#include "statistics.h"
+
+#include <QFileInfo>
+#include <QtEndian>
+#include <QSysInfo>
+#include <png.h>
+#include <csetjmp>
+#include <cstring>
+
+// libpng reports errors by longjmp, so every call gets its own setjmp.
+static bool writePngEnd(png_structp Png)
+{
+    if(setjmp(png_jmpbuf(Png)))
+        return false;
+    png_write_end(Png, nullptr);
+    return true;
+}
+
+HeightmapWriter::~HeightmapWriter()
+{
+}
+
+HeightmapWriter *HeightmapWriter::create(Format Type)
+{
+    switch(Type) {
+    case Png8Format:
+        return new PngWriter(8);
+    case Png16Format:
+        return new PngWriter(16);
+    case Float32Format:
+        return new RawFloatWriter();
+    case NumpyFormat:
+        return new NumpyWriter();
+    default:
+        return nullptr;
+    }
+}
+
+HeightmapWriter::Format HeightmapWriter::getFormat(QString Name)
+{
+    Name = Name.toLower();
+    if(Name == "png" || Name == "png8")
+        return Png8Format;
+    if(Name == "png16")
+        return Png16Format;
+    if(Name == "f32" || Name == "raw")
+        return Float32Format;
+    if(Name == "npy")
+        return NumpyFormat;
+    return UnknownFormat;
+}
+
+HeightmapWriter::Format HeightmapWriter::getFormatFromFilename(QString Filename)
+{
+    QString suffix = QFileInfo(Filename).suffix().toLower();
+    if(suffix == "png")
+        return Png8Format;
+    return getFormat(suffix);
+}
+
+QString HeightmapWriter::getSuffix(Format Type)
+{
+    switch(Type) {
+    case Png8Format:
+    case Png16Format:
+        return "png";
+    case Float32Format:
+        return "f32";
+    case NumpyFormat:
+        return "npy";
+    default:
+        return QString();
+    }
+}
+
+PngWriter::PngWriter(int BitDepth)
+{
+    bitDepth = BitDepth;
+    file = nullptr;
+    png = nullptr;
+    info = nullptr;
+    width = 0;
+    minimum = 0.;
+    maximum = 0.;
+}
+
+PngWriter::~PngWriter()
+{
+    close();
+}
+
+bool PngWriter::open(QString Filename, Grid &grid, double Minimum, double Maximum)
+{
+    ScopedTimer timer(Statistics::EncodeTimer);
+    close();
+    file = std::fopen(QFile::encodeName(Filename).constData(), "wb");
+    if(!file)
+        return false;
+
+    png_structp pngStruct = png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr, nullptr, nullptr);
+    png_infop pngInfo = pngStruct ? png_create_info_struct(pngStruct) : nullptr;
+    png = pngStruct;
+    info = pngInfo;
+    if(!pngInfo || setjmp(png_jmpbuf(pngStruct))) {
+        close();
+        return false;
+    }
+
+    png_init_io(pngStruct, file);
+    png_set_IHDR(pngStruct, pngInfo, png_uint_32(grid.getWindowWidth()), png_uint_32(grid.getWindowHeight()), bitDepth,
+                 PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_write_info(pngStruct, pngInfo);
+
+    width = grid.getWindowWidth();
+    minimum = Minimum;
+    maximum = Maximum;
+    row.resize(width*bitDepth/8);
+    return true;
+}
+
+bool PngWriter::writeRow(Grid &grid, int Row)
+{
+    if(!png)
+        return false;
+
+    uchar *target = row.data();
+    if(bitDepth == 16) {
+        // PNG stores 16 bit samples big-endian.
+        quint16 *samples = reinterpret_cast<quint16*>(target);
+        grid.quantizeRow(Row, minimum, maximum, samples);
+        for(int i=0; i<width; i++)
+            samples[i] = qToBigEndian(samples[i]);
+    }
+    else {
+        grid.quantizeRow(Row, minimum, maximum, target);
+    }
+
+    ScopedTimer timer(Statistics::EncodeTimer);
+    png_structp pngStruct = static_cast<png_structp>(png);
+    if(setjmp(png_jmpbuf(pngStruct)))
+        return false;
+    png_write_row(pngStruct, target);
+    Statistics::add(Statistics::OutputPixelsCounter, width);
+    return true;
+}
+
+bool PngWriter::close()
+{
+    if(!file)
+        return false;
+    ScopedTimer timer(Statistics::EncodeTimer);
+
+    // width is only set once the header has been written.
+    png_structp pngStruct = static_cast<png_structp>(png);
+    png_infop pngInfo = static_cast<png_infop>(info);
+    bool isWritten = width > 0 && writePngEnd(pngStruct);
+    if(pngStruct)
+        png_destroy_write_struct(&pngStruct, pngInfo ? &pngInfo : nullptr);
+    png = nullptr;
+    info = nullptr;
+    width = 0;
+
+    long size = std::ftell(file);
+    isWritten = std::fclose(file) == 0 && isWritten;
+    file = nullptr;
+    if(isWritten && size > 0)
+        Statistics::add(Statistics::BytesWrittenCounter, size);
+    return isWritten;
+}
+
+bool PngWriter::isNormalized()
+{
+    return true;
+}
+
+RawFloatWriter::RawFloatWriter()
+{
+    width = 0;
+}
+
+RawFloatWriter::~RawFloatWriter()
+{
+    close();
+}
+
+bool RawFloatWriter::open(QString Filename, Grid &grid, double Minimum, double Maximum)
+{
+    Q_UNUSED(Minimum);
+    Q_UNUSED(Maximum);
+    close();
+    ScopedTimer timer(Statistics::EncodeTimer);
+    file.setFileName(Filename);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+    if(!writeHeader(Filename, grid)) {
+        file.close();
+        return false;
+    }
+    width = grid.getWindowWidth();
+    row.resize(width);
+    return true;
+}
+
+bool RawFloatWriter::writeRow(Grid &grid, int Row)
+{
+    if(!file.isOpen())
+        return false;
+
+    float *target = row.data();
+    grid.getHeightRow(Row, target);
+    ScopedTimer timer(Statistics::EncodeTimer);
+    if(QSysInfo::ByteOrder == QSysInfo::BigEndian) {
+        for(int i=0; i<width; i++) {
+            quint32 bits;
+            std::memcpy(&bits, &target[i], sizeof(bits));
+            bits = qToLittleEndian(bits);
+            std::memcpy(&target[i], &bits, sizeof(bits));
+        }
+    }
+    qint64 size = qint64(width)*qint64(sizeof(float));
+    if(file.write(reinterpret_cast<const char*>(target), size) != size)
+        return false;
+    Statistics::add(Statistics::OutputPixelsCounter, width);
+    return true;
+}
+
+bool RawFloatWriter::close()
+{
+    if(!file.isOpen())
+        return false;
+    ScopedTimer timer(Statistics::EncodeTimer);
+    bool isWritten = file.flush();
+    qint64 size = file.size();
+    file.close();
+    if(isWritten)
+        Statistics::add(Statistics::BytesWrittenCounter, size);
+    return isWritten;
+}
+
+bool RawFloatWriter::isNormalized()
+{
+    return false;
+}
+
+bool RawFloatWriter::writeHeader(QString Filename, Grid &grid)
+{
+    QFileInfo info(Filename);
+    QFile header(info.path() + "/" + info.completeBaseName() + ".hdr");
+    if(!header.open(QIODevice::WriteOnly | QIODevice::Text))
+        return false;
+
+    // Rows run from the largest y down.
+    Coordinate2D topLeft = grid.getCoordinate2D(Pixel2D(grid.getWindowMinimum().i, grid.getWindowMaximum().j));
+    Coordinate2D slope = grid.getSlope();
+    QString text = QString("ENVI\n"
+                           "description = {WavefrontToHeatmap heights. Top-left pixel center: %1 %2. Pixel size: %3 %4.}\n"
+                           "samples = %5\n"
+                           "lines = %6\n"
+                           "bands = 1\n"
+                           "header offset = 0\n"
+                           "file type = ENVI Standard\n"
+                           "data type = 4\n"
+                           "interleave = bsq\n"
+                           "byte order = 0\n"
+                           "data ignore value = NaN\n")
+            .arg(QString::number(topLeft.x, 'g', 17))
+            .arg(QString::number(topLeft.y, 'g', 17))
+            .arg(QString::number(slope.x, 'g', 17))
+            .arg(QString::number(slope.y, 'g', 17))
+            .arg(grid.getWindowWidth())
+            .arg(grid.getWindowHeight());
+    QByteArray bytes = text.toUtf8();
+    if(header.write(bytes) != bytes.size())
+        return false;
+    Statistics::add(Statistics::BytesWrittenCounter, bytes.size());
+    return true;
+}
+
+bool NumpyWriter::writeHeader(QString Filename, Grid &grid)
+{
+    Q_UNUSED(Filename);
+    QByteArray dictionary = QString("{'descr': '<f4', 'fortran_order': False, 'shape': (%1, %2), }")
+            .arg(grid.getWindowHeight()).arg(grid.getWindowWidth()).toUtf8();
+    // Magic (6) + version (2) + length (2) + dictionary, padded with spaces
+    // and a final newline to a multiple of 64 bytes.
+    int length = 10 + dictionary.size() + 1;
+    int padding = (64 - length%64)%64;
+    dictionary.append(QByteArray(padding, ' '));
+    dictionary.append('\n');
+
+    QByteArray header("\x93NUMPY\x01\x00", 8);
+    quint16 dictionarySize = qToLittleEndian(quint16(dictionary.size()));
+    header.append(reinterpret_cast<const char*>(&dictionarySize), 2);
+    header.append(dictionary);
+    return file.write(header) == header.size();
+}
@@ -0,0 +1,101 @@
+#ifndef HEIGHTMAPWRITER_H
+#define HEIGHTMAPWRITER_H
+
+#include <QString>
+#include <QVector>
+#include <QFile>
+#include <cstdio>
+
+class Grid;
+
+// Writes a heatmap to a file one row at a time, top row (largest y) first.
+// The output covers the window of the grid passed to open(). Rows are taken
+// straight from a Grid, which may be any window of the same width that
+// contains the row being written.
+class HeightmapWriter
+{
+public:
+    enum Format {
+        Png8Format,    // 8 bit grayscale PNG, heights normalized to 0..255.
+        Png16Format,   // 16 bit grayscale PNG, heights normalized to 0..65535.
+        Float32Format, // Raw little-endian float32 heights plus an ENVI .hdr sidecar.
+        NumpyFormat,   // NumPy .npy file with a float32 (height, width) array.
+        UnknownFormat
+    };
+
+    virtual ~HeightmapWriter();
+
+    // grid provides the size and placement of the output. Minimum and
+    // Maximum are the height range mapped onto the output values; the float
+    // formats keep the heights as they are and write NaN for empty pixels.
+    virtual bool open(QString Filename, Grid &grid, double Minimum, double Maximum) = 0;
+    virtual bool writeRow(Grid &grid, int Row) = 0;
+    virtual bool close() = 0;
+    // Whether the output is scaled to the height range, which then has to be
+    // known before the first row is written.
+    virtual bool isNormalized() = 0;
+
+    static HeightmapWriter *create(Format Type);
+    // Parses a --format name: png, png16, f32 or npy.
+    static Format getFormat(QString Name);
+    static Format getFormatFromFilename(QString Filename);
+    static QString getSuffix(Format Type);
+};
+
+
+// Grayscale PNG through libpng. Rows are normalized, quantized and handed to
+// the encoder in a single pass, so only one row is ever buffered.
+class PngWriter : public HeightmapWriter
+{
+public:
+    PngWriter(int BitDepth = 8);
+    ~PngWriter();
+
+    bool open(QString Filename, Grid &grid, double Minimum, double Maximum);
+    bool writeRow(Grid &grid, int Row);
+    bool close();
+    bool isNormalized();
+
+private:
+    int bitDepth;
+    FILE *file;
+    void *png;
+    void *info;
+    int width;
+    double minimum;
+    double maximum;
+    QVector<uchar> row;
+};
+
+
+// Headerless little-endian float32 rows. The layout is described in an ENVI
+// header next to the data file (out.f32 -> out.hdr), which GDAL and most
+// terrain tools read.
+class RawFloatWriter : public HeightmapWriter
+{
+public:
+    RawFloatWriter();
+    ~RawFloatWriter();
+
+    bool open(QString Filename, Grid &grid, double Minimum, double Maximum);
+    bool writeRow(Grid &grid, int Row);
+    bool close();
+    bool isNormalized();
+
+protected:
+    virtual bool writeHeader(QString Filename, Grid &grid);
+
+    QFile file;
+    int width;
+    QVector<float> row;
+};
+
+
+// The same rows preceded by a version 1.0 .npy header.
+class NumpyWriter : public RawFloatWriter
+{
+protected:
+    bool writeHeader(QString Filename, Grid &grid);
+};
+
+#endif // HEIGHTMAPWRITER_H
@@ -0,0 +1,20 @@
+#QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = WavefrontToHeatmapKernelTest
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+INCLUDEPATH += ..
+
+SOURCES += \
+        main.cpp \
+        ../rasterkernel.cpp
+
+HEADERS += \
+        ../rasterkernel.h
+
+# The kernels must not differ from the scalar one by FMA contraction.
+*-g++*|*-clang*: QMAKE_CXXFLAGS += -ffp-contract=off
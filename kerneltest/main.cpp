@@ -0,0 +1,132 @@
+#include <QString>
+#include <QVector>
+#include <iostream>
+#include <cstring>
+#include <limits>
+
+#include "rasterkernel.h"
+
+// Runs every span kernel the processor supports against the scalar one on
+// the same rows and fails if a single depth, owner or write count differs.
+
+static const int maximumCount = 40;
+// Pixels past the span that no kernel may touch.
+static const int guard = 8;
+static const int owner = 7;
+
+enum Pattern {
+    RandomTargets,  // Heights around the plane, so about half the pixels are written.
+    EmptyTargets,   // -inf, as in a cleared grid: every pixel is written.
+    EqualTargets,   // Every other pixel already holds the exact height of the plane.
+    NumberOfPatterns
+};
+
+struct Row {
+    QVector<double> depth;
+    QVector<int> owners;
+};
+
+static quint64 state = 1;
+
+// 53 random bits from a 64 bit LCG, in [0, 1).
+static double getRandom()
+{
+    state = state*6364136223846793005ULL + 1442695040888963407ULL;
+    return double(state >> 11)/double(1ULL << 53);
+}
+
+static Row getRow(Pattern Type, int Count, double Start, double Step, int Offset)
+{
+    Row row;
+    row.depth.resize(Count + guard);
+    row.owners.resize(Count + guard);
+    for(int i=0; i<Count + guard; i++) {
+        double z = Start + double(Offset+i)*Step;
+        switch(Type) {
+        case RandomTargets:
+            row.depth[i] = z + (getRandom() - 0.5)*Step*4.;
+            break;
+        case EmptyTargets:
+            row.depth[i] = -std::numeric_limits<double>::infinity();
+            break;
+        default:
+            row.depth[i] = i%2 == 0 ? z : z - 1.;
+            break;
+        }
+        row.owners[i] = -1 - i%3;
+    }
+    return row;
+}
+
+static bool isIdentical(const Row &A, const Row &B)
+{
+    return memcmp(A.depth.constData(), B.depth.constData(), size_t(A.depth.size())*sizeof(double)) == 0 &&
+            memcmp(A.owners.constData(), B.owners.constData(), size_t(A.owners.size())*sizeof(int)) == 0;
+}
+
+// Runs one kernel, with and without owners, on all patterns, spans and
+// offsets; returns the number of failed cases.
+static int check(SpanKernel::Kind Type, int &Cases)
+{
+    SpanKernel::Function scalar = SpanKernel::getFunction(SpanKernel::ScalarKernel);
+    SpanKernel::OwnerFunction scalarOwners = SpanKernel::getOwnerFunction(SpanKernel::ScalarKernel);
+    SpanKernel::Function function = SpanKernel::getFunction(Type);
+    SpanKernel::OwnerFunction ownerFunction = SpanKernel::getOwnerFunction(Type);
+    const int offsets[] = {0, 1, 3, 17, 1000003};
+    const double starts[] = {0., -12.75, 1e6 + 0.1};
+    const double steps[] = {0.1, -0.37, 1./3.};
+
+    int failures = 0;
+    for(int p=0; p<NumberOfPatterns; p++) {
+        for(int count=0; count<=maximumCount; count++) {
+            for(int offset : offsets) {
+                for(double start : starts) {
+                    for(double step : steps) {
+                        Row reference = getRow(Pattern(p), count, start, step, offset);
+                        Row row = reference;
+                        Row referenceOwners = reference;
+                        Row rowOwners = reference;
+                        int referenceWrites = scalar(reference.depth.data(), count, start, step, offset);
+                        int writes = function(row.depth.data(), count, start, step, offset);
+                        int referenceOwnerWrites = scalarOwners(referenceOwners.depth.data(), referenceOwners.owners.data(),
+                                                                count, start, step, offset, owner);
+                        int ownerWrites = ownerFunction(rowOwners.depth.data(), rowOwners.owners.data(),
+                                                        count, start, step, offset, owner);
+                        Cases += 2;
+                        if(writes != referenceWrites || !isIdentical(row, reference)) {
+                            std::cout << SpanKernel::getName(Type).toStdString() << " differs: pattern " << p <<
+                                         ", count " << count << ", offset " << offset << ", start " << start <<
+                                         ", step " << step << "." << std::endl;
+                            failures++;
+                        }
+                        if(ownerWrites != referenceOwnerWrites || !isIdentical(rowOwners, referenceOwners)) {
+                            std::cout << SpanKernel::getName(Type).toStdString() << " with owners differs: pattern " <<
+                                         p << ", count " << count << ", offset " << offset << ", start " << start <<
+                                         ", step " << step << "." << std::endl;
+                            failures++;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return failures;
+}
+
+int main()
+{
+    int failures = 0;
+    for(int k=SpanKernel::ScalarKernel; k<SpanKernel::UnknownKernel; k++) {
+        SpanKernel::Kind kind = SpanKernel::Kind(k);
+        if(!SpanKernel::isSupported(kind)) {
+            std::cout << SpanKernel::getName(kind).toStdString() << ": not supported, skipped." << std::endl;
+            continue;
+        }
+        int cases = 0;
+        int kernelFailures = check(kind, cases);
+        std::cout << SpanKernel::getName(kind).toStdString() << ": " << cases - kernelFailures << " of " << cases <<
+                     " cases identical to scalar." << std::endl;
+        failures += kernelFailures;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,10 @@
+#QT -= gui
+
+TEMPLATE = lib
+CONFIG += c++17 staticlib
+
+TARGET = wavefronttoheatmap
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+include(../wavefront.pri)
@@ -1,12 +1,20 @@
 #include <QCoreApplication>
 #include <QString>
 #include <QDebug>
+#include <QFile>
 #include <QFileInfo>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QJsonObject>
 #include <iostream>
 #include <string>
 #include <math.h>
 
 #include "wavefront.h"
+#include "heatmapjob.h"
+#include "statistics.h"
+#include "rasterkernel.h"
+#include "renderserver.h"
 
 struct Input {
     bool wavefrontFilenameSupplied = false;
@@ -17,19 +25,100 @@ struct Input {
     bool outputFilenameValid = false;
     QString outputFilename = QString();
 
+    // Every value renders one output, all from a single load of the mesh.
     bool precisionSupplied = false;
     bool precisionValid = false;
-    double precision = 0.;
+    QVector<double> precisions;
 
     bool pixelCountSupplied = false;
     bool pixelCountValid = false;
-    double pixelCount = 0.;
+    QVector<double> pixelCounts;
+
+    bool manifestSupplied = false;
+    bool manifestValid = false;
+    QString manifestFilename = QString();
+
+    bool rasterModeSupplied = false;
+    bool rasterModeValid = false;
+    Wavefront::RasterMode rasterMode = Wavefront::EdgeFunctionRaster;
+    bool heightModeSupplied = false;
+    bool heightModeValid = false;
+    Wavefront::HeightMode heightMode = Wavefront::PlaneHeight;
+
+    bool sampleCountSupplied = false;
+    bool sampleCountValid = false;
+    int sampleCount = 1;
+    bool samplePatternSupplied = false;
+    bool samplePatternValid = false;
+    Wavefront::SamplePattern samplePattern = Wavefront::RotatedGridSamples;
+    bool resolveFilterSupplied = false;
+    bool resolveFilterValid = false;
+    Wavefront::ResolveFilter resolveFilter = Wavefront::MaximumResolve;
+
+    bool channelsSupplied = false;
+    bool channelsValid = false;
+    int channels = Grid::HeightChannel;
+
+    bool threadCountSupplied = false;
+    bool threadCountValid = false;
+    int threadCount = 1;
+
+    bool formatSupplied = false;
+    bool formatValid = false;
+    HeightmapWriter::Format format = HeightmapWriter::Png8Format;
+
+    bool maxMemorySupplied = false;
+    bool maxMemoryValid = false;
+    qint64 maxMemory = 0;
+
+    bool cropSupplied = false;
+    bool cropValid = false;
+    Coordinate2D cropMinimum, cropMaximum;
+
+    bool pyramidSupplied = false;
+    bool pyramidValid = false;
+    QString pyramidDirectory = QString();
+
+    bool zoomSupplied = false;
+    bool zoomValid = false;
+    int minimumZoom = 0;
+    int maximumZoom = 4;
+
+    bool useCache = false;
+    bool cacheDirectorySupplied = false;
+    bool cacheDirectoryValid = false;
+    QString cacheDirectory = QString();
+
+    bool statisticsSupplied = false;
+    bool statisticsValid = false;
+    bool statisticsAsJson = true;
+    bool statisticsFileSupplied = false;
+    bool statisticsFileValid = false;
+    QString statisticsFilename = QString();
+
+    bool serveSupplied = false;
+    bool meshCountSupplied = false;
+    bool meshCountValid = false;
+    int meshCount = 4;
 
     bool helpRequested = false;
 
     bool commandLine = true;
 };
 
+// Parses a comma separated list of positive numbers, as in -c 100000,400000.
+bool getValues(QString Text, double Minimum, QVector<double> &Values) {
+    QStringList parts = Text.split(",");
+    for(int i=0; i<parts.size(); i++) {
+        bool validConversion;
+        double value = parts[i].toDouble(&validConversion);
+        if(!validConversion || value < Minimum)
+            return false;
+        Values.append(value);
+    }
+    return true;
+}
+
 Input getInputParameters(int argc, char *argv[]) {
     Input input;
     for(int i=0; i<argc; i++) {
@@ -49,27 +138,213 @@ Input getInputParameters(int argc, char *argv[]) {
             if(i+1<argc) {
                 i++;
                 input.outputFilename = argv[i];
-                if(QFileInfo(input.outputFilename).isFile() || QFileInfo(input.outputFilename).suffix() == ".png") {
-                    input.wavefrontFilenameValid = true;
-                }
+                input.outputFilenameValid = !input.outputFilename.isEmpty();
             }
         }
         else if(argument == "-p") {
+            bool isFirst = !input.precisionSupplied;
             input.precisionSupplied = true;
             if(i+1<argc) {
                 i++;
-                bool validConversion;
-                input.precision = QString(argv[i]).toDouble(&validConversion);
-                input.precisionValid = validConversion;
+                bool validValues = getValues(argv[i], 1e-300, input.precisions);
+                input.precisionValid = (isFirst || input.precisionValid) && validValues;
             }
         }
         else if(argument == "-c") {
+            bool isFirst = !input.pixelCountSupplied;
             input.pixelCountSupplied = true;
+            if(i+1<argc) {
+                i++;
+                bool validValues = getValues(argv[i], 1., input.pixelCounts);
+                input.pixelCountValid = (isFirst || input.pixelCountValid) && validValues;
+            }
+        }
+        else if(argument == "--jobs") {
+            input.manifestSupplied = true;
+            if(i+1<argc) {
+                i++;
+                input.manifestFilename = argv[i];
+                input.manifestValid = QFileInfo(input.manifestFilename).isFile();
+            }
+        }
+        else if(argument == "-m") {
+            input.rasterModeSupplied = true;
+            if(i+1<argc) {
+                i++;
+                std::string mode = argv[i];
+                if(mode == "edge") {
+                    input.rasterMode = Wavefront::EdgeFunctionRaster;
+                    input.rasterModeValid = true;
+                }
+                else if(mode == "crossing") {
+                    input.rasterMode = Wavefront::CrossingTestRaster;
+                    input.rasterModeValid = true;
+                }
+            }
+        }
+        else if(argument == "--heights") {
+            input.heightModeSupplied = true;
+            if(i+1<argc) {
+                i++;
+                std::string mode = argv[i];
+                if(mode == "plane") {
+                    input.heightMode = Wavefront::PlaneHeight;
+                    input.heightModeValid = true;
+                }
+                else if(mode == "stepped") {
+                    input.heightMode = Wavefront::RowSteppedHeight;
+                    input.heightModeValid = true;
+                }
+            }
+        }
+        else if(argument == "--samples") {
+            input.sampleCountSupplied = true;
             if(i+1<argc) {
                 i++;
                 bool validConversion;
-                input.pixelCount = QString(argv[i]).toInt(&validConversion);
-                input.pixelCountValid = validConversion;
+                input.sampleCount = QString(argv[i]).toInt(&validConversion);
+                input.sampleCountValid = validConversion;
+            }
+        }
+        else if(argument == "--sample-pattern") {
+            input.samplePatternSupplied = true;
+            if(i+1<argc) {
+                i++;
+                std::string pattern = argv[i];
+                if(pattern == "rotated") {
+                    input.samplePattern = Wavefront::RotatedGridSamples;
+                    input.samplePatternValid = true;
+                }
+                else if(pattern == "stratified") {
+                    input.samplePattern = Wavefront::StratifiedSamples;
+                    input.samplePatternValid = true;
+                }
+            }
+        }
+        else if(argument == "--resolve") {
+            input.resolveFilterSupplied = true;
+            if(i+1<argc) {
+                i++;
+                std::string filter = argv[i];
+                if(filter == "max") {
+                    input.resolveFilter = Wavefront::MaximumResolve;
+                    input.resolveFilterValid = true;
+                }
+                else if(filter == "mean") {
+                    input.resolveFilter = Wavefront::MeanResolve;
+                    input.resolveFilterValid = true;
+                }
+                else if(filter == "min") {
+                    input.resolveFilter = Wavefront::MinimumResolve;
+                    input.resolveFilterValid = true;
+                }
+            }
+        }
+        else if(argument == "--channels") {
+            input.channelsSupplied = true;
+            if(i+1<argc) {
+                i++;
+                QStringList names = QString(argv[i]).split(",");
+                input.channelsValid = true;
+                for(int k=0; k<names.size(); k++) {
+                    Grid::Channel type = Grid::getChannelType(names[k].trimmed());
+                    input.channels |= type;
+                    input.channelsValid = input.channelsValid && type != Grid::UnknownChannel;
+                }
+            }
+        }
+        else if(argument == "-j") {
+            input.threadCountSupplied = true;
+            if(i+1<argc) {
+                i++;
+                bool validConversion;
+                input.threadCount = QString(argv[i]).toInt(&validConversion);
+                input.threadCountValid = validConversion && input.threadCount >= 0;
+            }
+        }
+        else if(argument == "--format") {
+            input.formatSupplied = true;
+            if(i+1<argc) {
+                i++;
+                input.format = HeightmapWriter::getFormat(argv[i]);
+                input.formatValid = input.format != HeightmapWriter::UnknownFormat;
+            }
+        }
+        else if(argument == "--max-memory") {
+            input.maxMemorySupplied = true;
+            if(i+1<argc) {
+                i++;
+                input.maxMemoryValid = HeatmapJob::parseMemorySize(argv[i], input.maxMemory);
+            }
+        }
+        else if(argument == "--crop") {
+            input.cropSupplied = true;
+            if(i+1<argc) {
+                i++;
+                input.cropValid = HeatmapJob::parseRectangle(argv[i], input.cropMinimum, input.cropMaximum);
+            }
+        }
+        else if(argument == "--pyramid") {
+            input.pyramidSupplied = true;
+            if(i+1<argc) {
+                i++;
+                input.pyramidDirectory = argv[i];
+                input.pyramidValid = !input.pyramidDirectory.isEmpty();
+            }
+        }
+        else if(argument == "--zoom") {
+            input.zoomSupplied = true;
+            if(i+1<argc) {
+                i++;
+                QStringList values = QString(argv[i]).split("-");
+                bool validMinimum = false;
+                bool validMaximum = false;
+                input.minimumZoom = values[0].toInt(&validMinimum);
+                input.maximumZoom = values.size() > 1 ? values[1].toInt(&validMaximum) : input.minimumZoom;
+                validMaximum = values.size() == 1 || validMaximum;
+                input.zoomValid = values.size() <= 2 && validMinimum && validMaximum &&
+                        input.minimumZoom >= 0 && input.minimumZoom <= input.maximumZoom && input.maximumZoom <= 24;
+            }
+        }
+        else if(argument == "--cache") {
+            input.useCache = true;
+        }
+        else if(argument == "--cache-dir") {
+            input.useCache = true;
+            input.cacheDirectorySupplied = true;
+            if(i+1<argc) {
+                i++;
+                input.cacheDirectory = argv[i];
+                input.cacheDirectoryValid = !input.cacheDirectory.isEmpty();
+            }
+        }
+        else if(argument == "--stats") {
+            input.statisticsSupplied = true;
+            if(i+1<argc) {
+                i++;
+                std::string format = argv[i];
+                input.statisticsAsJson = format == "json";
+                input.statisticsValid = format == "json" || format == "text";
+            }
+        }
+        else if(argument == "--stats-file") {
+            input.statisticsFileSupplied = true;
+            if(i+1<argc) {
+                i++;
+                input.statisticsFilename = argv[i];
+                input.statisticsFileValid = !input.statisticsFilename.isEmpty();
+            }
+        }
+        else if(argument == "--serve") {
+            input.serveSupplied = true;
+        }
+        else if(argument == "--serve-meshes") {
+            input.meshCountSupplied = true;
+            if(i+1<argc) {
+                i++;
+                bool validConversion;
+                input.meshCount = QString(argv[i]).toInt(&validConversion);
+                input.meshCountValid = validConversion && input.meshCount >= 1;
             }
         }
         else if(argument == "-h") {
@@ -77,25 +352,39 @@ Input getInputParameters(int argc, char *argv[]) {
         }
     }
 
-    if(!input.pixelCountSupplied && !input.precisionSupplied) {
-        input.pixelCount = 500000;
+    if(!input.pixelCountSupplied && !input.precisionSupplied && !input.manifestSupplied) {
+        input.pixelCounts.append(500000);
         input.pixelCountValid = true;
     }
 
-    if(!input.outputFilenameSupplied && input.wavefrontFilenameValid) {
-        input.outputFilenameValid = true;
-        input.outputFilename = QFileInfo(input.wavefrontFilename).absoluteFilePath().replace(".obj", "") + ".png";
+    // Without --format the output file's extension decides, anything unknown
+    // stays an 8 bit png as before.
+    if(!input.formatSupplied && input.outputFilenameValid) {
+        HeightmapWriter::Format format = HeightmapWriter::getFormatFromFilename(input.outputFilename);
+        if(format != HeightmapWriter::UnknownFormat)
+            input.format = format;
     }
 
     return input;
 }
 
 bool checkInput(Input input) {
-    if(!input.wavefrontFilenameSupplied) {
+    if(input.meshCountSupplied && !input.meshCountValid) {
+        std::cout << "Invalid mesh count. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.serveSupplied) {
+        if(input.wavefrontFilenameSupplied || input.pixelCountSupplied || input.precisionSupplied || input.manifestSupplied ||
+                input.pyramidSupplied) {
+            std::cout << "The server takes its jobs from stdin, not from -i, -c, -p, --jobs or --pyramid. Type -h for further help." << std::endl;
+            return false;
+        }
+    }
+    else if(!input.wavefrontFilenameSupplied) {
         std::cout << "No input file supplied. Type -h for further help." << std::endl;
         return false;
     }
-    if(!input.wavefrontFilenameValid) {
+    else if(!input.wavefrontFilenameValid) {
         std::cout << "Invalid input file. Type -h for further help." << std::endl;
         return false;
     }
@@ -107,6 +396,79 @@ bool checkInput(Input input) {
         std::cout << "Invalid pixel count. Type -h for further help." << std::endl;
         return false;
     }
+    if(input.rasterModeSupplied && !input.rasterModeValid) {
+        std::cout << "Invalid raster mode. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.heightModeSupplied && !input.heightModeValid) {
+        std::cout << "Invalid height mode. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.samplePatternSupplied && !input.samplePatternValid) {
+        std::cout << "Invalid sample pattern. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.sampleCountSupplied && !(input.sampleCountValid &&
+                                      Wavefront::isValidSampling(input.sampleCount, input.samplePattern))) {
+        std::cout << "Invalid sample count. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.resolveFilterSupplied && !input.resolveFilterValid) {
+        std::cout << "Invalid resolve filter. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.channelsSupplied && !input.channelsValid) {
+        std::cout << "Invalid channel list. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.channels != Grid::HeightChannel && (input.sampleCount > 1 || input.pyramidSupplied)) {
+        std::cout << "Further channels can not be combined with --samples or --pyramid. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.threadCountSupplied && !input.threadCountValid) {
+        std::cout << "Invalid thread count. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.maxMemorySupplied && !input.maxMemoryValid) {
+        std::cout << "Invalid memory size. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.cropSupplied && !input.cropValid) {
+        std::cout << "Invalid crop rectangle. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.cropSupplied && input.maxMemorySupplied) {
+        std::cout << "A crop can not be combined with a memory limit. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.pyramidSupplied && !input.pyramidValid) {
+        std::cout << "Invalid pyramid directory. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.zoomSupplied && !input.zoomValid) {
+        std::cout << "Invalid zoom range. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.cacheDirectorySupplied && !input.cacheDirectoryValid) {
+        std::cout << "Invalid cache directory. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.statisticsSupplied && !input.statisticsValid) {
+        std::cout << "Invalid statistics format. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.statisticsFileSupplied && !input.statisticsFileValid) {
+        std::cout << "Invalid statistics file. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.manifestSupplied && !input.manifestValid) {
+        std::cout << "Invalid job manifest. Type -h for further help." << std::endl;
+        return false;
+    }
+    if(input.manifestSupplied && (input.pixelCountSupplied || input.precisionSupplied)) {
+        std::cout << "A job manifest can not be combined with -c or -p. Type -h for further help." << std::endl;
+        return false;
+    }
     if(input.pixelCountSupplied && input.precisionSupplied) {
         std::cout << "Both pixel count and precision are supplied. Type -h for further help." << std::endl;
         return false;
@@ -114,21 +476,146 @@ bool checkInput(Input input) {
     return true;
 }
 
-void saveImageByPrecision(Input input) {
-    Wavefront* obj = new Wavefront(input.wavefrontFilename, input.commandLine);
-    Grid heatmap = obj->getHeatmap(input.precision);
-    QImage image = obj->getImage(heatmap);
-    obj->saveImage(image, input.outputFilename);
+bool savePyramid(Input input) {
+    Wavefront obj(input.wavefrontFilename, input.commandLine, input.useCache, input.cacheDirectory,
+                  input.threadCountSupplied ? input.threadCount : 0);
+    obj.setRasterMode(input.rasterMode);
+    obj.setHeightMode(input.heightMode);
+    obj.setSampling(input.sampleCount, input.samplePattern);
+    obj.setResolveFilter(input.resolveFilter);
+    obj.setThreadCount(input.threadCount);
+    bool isWritten;
+    if(input.cropSupplied)
+        isWritten = obj.savePyramid(input.pyramidDirectory, input.minimumZoom, input.maximumZoom,
+                                    input.cropMinimum, input.cropMaximum, input.format);
+    else
+        isWritten = obj.savePyramid(input.pyramidDirectory, input.minimumZoom, input.maximumZoom, input.format);
+    if(!isWritten)
+        std::cout << "Could not write the tile pyramid." << std::endl;
+    return isWritten;
 }
 
-void saveImageByPixelCount(Input input) {
-    Wavefront* obj = new Wavefront(input.wavefrontFilename, input.commandLine);
-    double width = obj->getWidth();
-    double height = obj->getHeight();
-    double precision = std::sqrt((width*height)/double(input.pixelCount));
-    Grid heatmap = obj->getHeatmap(precision);
-    QImage image = obj->getImage(heatmap);
-    obj->saveImage(image, input.outputFilename);
+// With more than one job every output gets its resolution appended, e.g.
+// Monkey_c500000.png next to Monkey_c2000000.png.
+QString getOutputFilename(Input input, HeatmapJob job, bool isBatch) {
+    QString suffix = HeightmapWriter::getSuffix(job.format);
+    QString base;
+    if(input.outputFilenameSupplied) {
+        if(!isBatch)
+            return input.outputFilename;
+        QFileInfo output(input.outputFilename);
+        base = output.suffix().isEmpty() ? input.outputFilename : input.outputFilename.left(input.outputFilename.size() - output.suffix().size() - 1);
+    }
+    else {
+        base = QFileInfo(input.wavefrontFilename).absoluteFilePath().replace(".obj", "");
+    }
+    if(!isBatch)
+        return base + "." + suffix;
+    QString resolution = job.precision > 0. ? "p" + QString::number(job.precision) : "c" + QString::number(job.pixelCount);
+    return base + "_" + resolution + "." + suffix;
+}
+
+bool getJobs(Input input, QVector<HeatmapJob> &jobs) {
+    HeatmapJob defaults;
+    defaults.format = input.format;
+    defaults.hasCrop = input.cropSupplied;
+    defaults.cropMinimum = input.cropMinimum;
+    defaults.cropMaximum = input.cropMaximum;
+    defaults.maxMemory = input.maxMemorySupplied ? input.maxMemory : 0;
+
+    if(input.manifestSupplied) {
+        QString error;
+        if(!HeatmapJob::readManifest(input.manifestFilename, defaults, jobs, error)) {
+            std::cout << error.toStdString() << std::endl;
+            return false;
+        }
+    }
+    for(int i=0; i<input.pixelCounts.size(); i++) {
+        HeatmapJob job = defaults;
+        job.pixelCount = qint64(input.pixelCounts[i]);
+        jobs.append(job);
+    }
+    for(int i=0; i<input.precisions.size(); i++) {
+        HeatmapJob job = defaults;
+        job.precision = input.precisions[i];
+        jobs.append(job);
+    }
+
+    bool isBatch = jobs.size() > 1;
+    for(int i=0; i<jobs.size(); i++) {
+        if(jobs[i].outputFilename.isEmpty())
+            jobs[i].outputFilename = getOutputFilename(input, jobs[i], isBatch);
+    }
+    return true;
+}
+
+bool saveImages(Input input) {
+    QVector<HeatmapJob> jobs;
+    if(!getJobs(input, jobs))
+        return false;
+
+    Wavefront wavefront(input.wavefrontFilename, input.commandLine, input.useCache, input.cacheDirectory,
+                        input.threadCountSupplied ? input.threadCount : 0);
+    wavefront.setRasterMode(input.rasterMode);
+    wavefront.setHeightMode(input.heightMode);
+    wavefront.setSampling(input.sampleCount, input.samplePattern);
+    wavefront.setResolveFilter(input.resolveFilter);
+    wavefront.setChannels(input.channels);
+    wavefront.setThreadCount(input.threadCount);
+    bool isWritten = wavefront.renderBatch(jobs);
+    for(int i=0; i<jobs.size(); i++) {
+        if(!jobs[i].isWritten)
+            std::cout << "Could not write " << jobs[i].outputFilename.toStdString() << "." << std::endl;
+    }
+    return isWritten;
+}
+
+// Answers render requests from stdin until it is closed, see RenderServer.
+bool serve(Input input) {
+    RenderServer server(input.threadCountSupplied ? input.threadCount : 0, input.meshCount);
+    server.setRasterMode(input.rasterMode);
+    server.setHeightMode(input.heightMode);
+    server.setSampling(input.sampleCount, input.samplePattern);
+    server.setResolveFilter(input.resolveFilter);
+    server.setChannels(input.channels);
+    server.setCache(input.useCache, input.cacheDirectory);
+    return server.serve(std::cin, std::cout);
+}
+
+// The report of --stats, to stdout or the --stats-file. JSON goes on a single
+// line so that it can be picked out of the progress output.
+void outputStatistics(Input input, qint64 Elapsed, bool IsWritten) {
+    QByteArray report;
+    if(input.statisticsAsJson) {
+        QJsonObject json = Statistics::toJson();
+        json.insert("input", QFileInfo(input.wavefrontFilename).absoluteFilePath());
+        json.insert("seconds", double(Elapsed)/1e9);
+        json.insert("succeeded", IsWritten);
+        json.insert("kernel", SpanKernel::getName(SpanKernel::getKind()));
+        report = QJsonDocument(json).toJson(QJsonDocument::Compact) + "\n";
+    }
+    else {
+        QString text = QString("Total: %1 s.\n").arg(double(Elapsed)/1e9);
+        text += QString("kernel: %1.\n").arg(SpanKernel::getName(SpanKernel::getKind()));
+        for(int i=0; i<Statistics::NumberOfTimers; i++) {
+            Statistics::Timer timer = Statistics::Timer(i);
+            text += QString("%1: %2 s, %3 calls.\n").arg(Statistics::getName(timer))
+                    .arg(double(Statistics::getTime(timer))/1e9).arg(Statistics::getCalls(timer));
+        }
+        for(int i=0; i<Statistics::NumberOfCounters; i++) {
+            Statistics::Counter counter = Statistics::Counter(i);
+            text += QString("%1: %2.\n").arg(Statistics::getName(counter)).arg(Statistics::getCount(counter));
+        }
+        report = text.toUtf8();
+    }
+
+    if(!input.statisticsFileSupplied) {
+        std::cout << report.constData() << std::flush;
+        return;
+    }
+    QFile file(input.statisticsFilename);
+    if(!file.open(QIODevice::WriteOnly) || file.write(report) != report.size())
+        std::cout << "Could not write " << input.statisticsFilename.toStdString() << "." << std::endl;
 }
 
 void displayHelp() {
@@ -137,13 +624,51 @@ void displayHelp() {
     std::cout << std::endl;
     std::cout << "IO settings:" << std::endl;
     std::cout << "-i <InputFile>" << "\t" << "Specify an input Wavefront obj file. (MANDATORY)" << std::endl;
-    std::cout << "-o <OutputFile>" << "\t" << "Specify an output png file." << std::endl;
+    std::cout << "--cache" << "\t" << "Keep the parsed mesh in a binary cache next to the input file (<InputFile>.w2hmesh) and reuse it while the input is unchanged." << std::endl;
+    std::cout << "--cache-dir <Directory>" << "\t" << "Like --cache, but keep the cache in Directory." << std::endl;
+    std::cout << "-o <OutputFile>" << "\t" << "Specify an output file. The format follows from its extension (.png, .f32, .npy)." << std::endl;
+    std::cout << "--format <Format>" << "\t" << "png (8 bit, default), png16, f32 (raw float32 with .hdr sidecar) or npy." << std::endl;
     std::cout << std::endl;
     std::cout << "Resolution settings:" << std::endl;
     std::cout << "You can either specify the pixel count or the precision." <<
                  "Only specify one of the following two parameters. If none is specified the default value -c 500000 will be used." << std::endl;
     std::cout << "-c <PixelCount>" << "\t" << "Specify the output file's pixel count." << std::endl;
     std::cout << "-p <Precision>" << "\t" << "Specify the output file's precision." << std::endl;
+    std::cout << "Both take comma separated lists and may be repeated. Every value renders one output from the same parsed mesh, " <<
+                 "named <OutputFile>_c<PixelCount> or <OutputFile>_p<Precision>." << std::endl;
+    std::cout << "--jobs <Manifest>" << "\t" << "Render the jobs listed in Manifest, one per line, written with the options -c, -p, -o, --format, --crop and --max-memory." << std::endl;
+    std::cout << std::endl;
+    std::cout << "Rendering settings:" << std::endl;
+    std::cout << "-m <RasterMode>" << "\t" << "Either edge (scanline rasterizer, default) or crossing (per-pixel reference test)." << std::endl;
+    std::cout << "--heights <HeightMode>" << "\t" << "Either plane (evaluate every face's plane per row, default) or stepped (step from row to row by a fixed amount)." << std::endl;
+    std::cout << "--samples <Count>" << "\t" << "Render every pixel from this many samples, default 1. 2, 4, 8 or 16 on a rotated grid, " <<
+                 "or a square number up to 256 with the stratified pattern." << std::endl;
+    std::cout << "--sample-pattern <Pattern>" << "\t" << "Either rotated (default) or stratified (one jittered sample per cell of a square grid)." << std::endl;
+    std::cout << "--resolve <Filter>" << "\t" << "How the samples make up a pixel: max (highest sample, default), " <<
+                 "mean (average of the covered samples, anti-aliased edges) or min (lowest covered sample)." << std::endl;
+    std::cout << "--channels <List>" << "\t" << "Comma separated channels rendered in the same pass: height (always), bottom (lowest face), " <<
+                 "count (faces covering the pixel), thickness (highest minus lowest face), object (index of the top object) and slope " <<
+                 "(of the top face in degrees). Every channel but the height goes to <OutputFile>_<channel>." << std::endl;
+    std::cout << "-j <Threads>" << "\t" << "Render tiles on this many threads. 0 uses all cores, the default 1 renders serially. "
+              << "The obj file is parsed on as many threads, or on all cores without -j." << std::endl;
+    std::cout << "--crop <MinX,MinY,MaxX,MaxY>" << "\t" << "Only render this rectangle of the heatmap. The resolution still refers to the whole mesh." << std::endl;
+    std::cout << std::endl;
+    std::cout << "Tile pyramid:" << std::endl;
+    std::cout << "--pyramid <Directory>" << "\t" << "Write 256x256 tiles as <Directory>/<zoom>/<x>/<y> instead of a single image. -o, -c and -p are ignored, --crop sets the covered area." << std::endl;
+    std::cout << "--zoom <Min-Max>" << "\t" << "Zoom levels of the pyramid, default 0-4." << std::endl;
+    std::cout << std::endl;
+    std::cout << "Memory settings:" << std::endl;
+    std::cout << "--max-memory <Size>" << "\t" << "Render in horizontal bands whose depth buffer stays below Size, e.g. 512M or 2G. Fails if a single row needs more." << std::endl;
+    std::cout << std::endl;
+    std::cout << "Server:" << std::endl;
+    std::cout << "--serve" << "\t" << "Read render requests from stdin, one JSON object per line, and answer each with a JSON line once done. " <<
+                 "Keys: id, input, output, pixelCount or precision, format, crop [MinX,MinY,MaxX,MaxY] and maxMemory. " <<
+                 "Requests run side by side on -j threads (all cores by default); -m, --heights, --samples, --sample-pattern, --resolve, --channels and --cache apply to every mesh." << std::endl;
+    std::cout << "--serve-meshes <Count>" << "\t" << "Keep the meshes of this many obj files loaded, the least recently used are dropped first. Default 4." << std::endl;
+    std::cout << std::endl;
+    std::cout << "Statistics:" << std::endl;
+    std::cout << "--stats <Format>" << "\t" << "At exit report the time spent in every stage and the work done, as json or text." << std::endl;
+    std::cout << "--stats-file <File>" << "\t" << "Write the report to File instead of stdout. Implies --stats json." << std::endl;
 }
 
 
@@ -154,33 +679,37 @@ int main(int argc, char *argv[])
 
     Input input = getInputParameters(argc, argv);
 
-    input.wavefrontFilename = "/home/peter/Qt/WavefrontToHeatmap/y.obj";
-    input.wavefrontFilenameSupplied = input.wavefrontFilenameValid = true;
-
-    input.pixelCount = 50000;
-    input.pixelCountSupplied = input.precisionValid = true;
-
     if(input.helpRequested) { // Display help
         displayHelp();
         return 0;
     }
 
     if(!checkInput(input)) // Stop
-        return 0;
+        return 1;
 
-    if(input.pixelCountSupplied) {
-        saveImageByPixelCount(input);
+    bool isReported = input.statisticsSupplied || input.statisticsFileSupplied;
+    Statistics::setEnabled(isReported);
+    QElapsedTimer timer;
+    timer.start();
+
+    bool isWritten;
+    if(input.serveSupplied) {
+        isWritten = serve(input);
     }
-    else if(input.precisionSupplied) {
-        saveImageByPrecision(input);
+    else if(input.pyramidSupplied) {
+        isWritten = savePyramid(input);
     }
     else {
-        std::cout << "Setting default value -c 500000." << std::endl;
-        saveImageByPixelCount(input);
+        if(!input.pixelCountSupplied && !input.precisionSupplied && !input.manifestSupplied)
+            std::cout << "Setting default value -c 500000." << std::endl;
+        isWritten = saveImages(input);
     }
-    std::cout << "Finished." << std::endl;
-
+    if(!input.serveSupplied)
+        std::cout << (isWritten ? "Finished." : "Failed.") << std::endl;
 
+    if(isReported)
+        outputStatistics(input, timer.nsecsElapsed(), isWritten);
 
-    return 0;
+    // Nonzero if any output could not be written, for scripts and schedulers.
+    return isWritten ? 0 : 1;
 }
@@ -0,0 +1,220 @@
+#include "meshcache.h"
+#include "statistics.h"
+
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <cstring>
+
+MeshCache::MeshCache(QString WavefrontFilename, QString CacheDirectory)
+{
+    source = QFileInfo(WavefrontFilename);
+    if(CacheDirectory.isEmpty()) {
+        cacheFilename = source.absoluteFilePath() + ".w2hmesh";
+    }
+    else {
+        // Files of the same name from different directories must not collide.
+        QString key = QString::number(qHash(source.absoluteFilePath()), 16);
+        cacheFilename = QDir(CacheDirectory).filePath(source.fileName() + "-" + key + ".w2hmesh");
+    }
+}
+
+QString MeshCache::getCacheFilename()
+{
+    return cacheFilename;
+}
+
+bool MeshCache::load(QVector<WavefrontObject> &Objects)
+{
+    ScopedTimer timer(Statistics::CacheTimer);
+    QFile file(cacheFilename);
+    if(!source.exists() || !file.open(QIODevice::ReadOnly))
+        return false;
+    qint64 size = file.size();
+    if(size < qint64(sizeof(Header)))
+        return false;
+    const uchar *data = file.map(0, size);
+    if(!data)
+        return false;
+    Statistics::add(Statistics::BytesReadCounter, size);
+
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+    if(std::memcmp(header.magic, "W2HMESH", 8) != 0 || header.version != version ||
+       header.byteOrder != byteOrderMark || header.sourceSize != source.size() ||
+       header.sourceModified != source.lastModified().toMSecsSinceEpoch() || header.objectCount < 0)
+        return false;
+
+    // Every read is checked against the file size, a truncated cache is
+    // rejected instead of read past its end.
+    QVector<WavefrontObject> objects;
+    qint64 position = sizeof(Header);
+    for(qint64 o=0; o<header.objectCount; o++) {
+        ObjectHeader objectHeader;
+        if(position + qint64(sizeof(objectHeader)) > size)
+            return false;
+        std::memcpy(&objectHeader, data + position, sizeof(objectHeader));
+        position += sizeof(objectHeader);
+        if(objectHeader.nameLength < 0 || objectHeader.vertexCount < 0 || objectHeader.normalCount < 0 ||
+           objectHeader.indexCount < 0 || objectHeader.faceCount < 0)
+            return false;
+
+        qint64 nameSize = getPaddedSize(objectHeader.nameLength);
+        qint64 vertexSize = qint64(objectHeader.vertexCount)*3*qint64(sizeof(double));
+        qint64 normalSize = qint64(objectHeader.normalCount)*3*qint64(sizeof(double));
+        qint64 indexSize = getPaddedSize(qint64(objectHeader.indexCount)*qint64(sizeof(qint32)));
+        qint64 faceSize = qint64(objectHeader.faceCount)*qint64(sizeof(FaceRecord));
+        if(position + nameSize + vertexSize + normalSize + indexSize + faceSize > size)
+            return false;
+
+        WavefrontObject object;
+        object.name = QString::fromUtf8(reinterpret_cast<const char*>(data + position), objectHeader.nameLength);
+        position += nameSize;
+
+        const double *coordinates = reinterpret_cast<const double*>(data + position);
+        object.vertices.resize(objectHeader.vertexCount);
+        for(int i=0; i<objectHeader.vertexCount; i++)
+            object.vertices[i] = Coordinate3D(coordinates[3*i], coordinates[3*i+1], coordinates[3*i+2]);
+        position += vertexSize;
+
+        coordinates = reinterpret_cast<const double*>(data + position);
+        object.normals.resize(objectHeader.normalCount);
+        for(int i=0; i<objectHeader.normalCount; i++)
+            object.normals[i] = Coordinate3D(coordinates[3*i], coordinates[3*i+1], coordinates[3*i+2]);
+        position += normalSize;
+
+        object.indices.resize(objectHeader.indexCount);
+        std::memcpy(object.indices.data(), data + position, size_t(objectHeader.indexCount)*sizeof(qint32));
+        position += indexSize;
+
+        const FaceRecord *records = reinterpret_cast<const FaceRecord*>(data + position);
+        object.faces.resize(objectHeader.faceCount);
+        for(int i=0; i<objectHeader.faceCount; i++) {
+            const FaceRecord &record = records[i];
+            if(record.firstIndex < 0 ||
+               qint64(record.firstIndex) + WavefrontFace::vertexCount > objectHeader.indexCount ||
+               record.normal < -1 || record.normal >= objectHeader.normalCount)
+                return false;
+            WavefrontFace &face = object.faces[i];
+            face.firstIndex = record.firstIndex;
+            face.normal = record.normal;
+            face.minimum = Coordinate2D(record.minimum[0], record.minimum[1]);
+            face.maximum = Coordinate2D(record.maximum[0], record.maximum[1]);
+            face.planeSlope = Coordinate2D(record.planeSlope[0], record.planeSlope[1]);
+            face.planeHeight = record.planeHeight;
+        }
+        position += faceSize;
+
+        for(int i=0; i<object.indices.size(); i++) {
+            if(object.indices[i] < 0 || object.indices[i] >= objectHeader.vertexCount)
+                return false;
+        }
+        objects.append(object);
+    }
+
+    Objects = objects;
+    return true;
+}
+
+bool MeshCache::save(const QVector<WavefrontObject> &Objects)
+{
+    ScopedTimer timer(Statistics::CacheTimer);
+    if(!source.exists())
+        return false;
+    QFileInfo cacheInfo(cacheFilename);
+    if(!QDir().mkpath(cacheInfo.absolutePath()))
+        return false;
+
+    // Written under a temporary name and renamed at the end, so readers
+    // never see a partial cache.
+    QSaveFile file(cacheFilename);
+    if(!file.open(QIODevice::WriteOnly))
+        return false;
+
+    Header header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, "W2HMESH", 8);
+    header.version = version;
+    header.byteOrder = byteOrderMark;
+    header.sourceSize = source.size();
+    header.sourceModified = source.lastModified().toMSecsSinceEpoch();
+    header.objectCount = Objects.size();
+    bool isWritten = writePadded(file, reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for(int o=0; o<Objects.size() && isWritten; o++) {
+        const WavefrontObject &object = Objects[o];
+        QByteArray name = object.name.toUtf8();
+        ObjectHeader objectHeader;
+        objectHeader.nameLength = name.size();
+        objectHeader.vertexCount = object.vertices.size();
+        objectHeader.normalCount = object.normals.size();
+        objectHeader.indexCount = object.indices.size();
+        objectHeader.faceCount = object.faces.size();
+        objectHeader.reserved = 0;
+
+        isWritten = writePadded(file, reinterpret_cast<const char*>(&objectHeader), sizeof(objectHeader)) &&
+                writePadded(file, name.constData(), name.size()) &&
+                writeCoordinates(file, object.vertices) &&
+                writeCoordinates(file, object.normals) &&
+                writePadded(file, reinterpret_cast<const char*>(object.indices.constData()),
+                            qint64(object.indices.size())*qint64(sizeof(qint32)));
+
+        QVector<FaceRecord> records(object.faces.size());
+        for(int i=0; i<object.faces.size(); i++) {
+            WavefrontFace face = object.faces[i];
+            FaceRecord &record = records[i];
+            record.firstIndex = face.firstIndex;
+            record.normal = face.normal;
+            record.minimum[0] = face.getMinimum().x;
+            record.minimum[1] = face.getMinimum().y;
+            record.maximum[0] = face.getMaximum().x;
+            record.maximum[1] = face.getMaximum().y;
+            record.planeSlope[0] = face.getPlaneSlope().x;
+            record.planeSlope[1] = face.getPlaneSlope().y;
+            record.planeHeight = face.planeHeight;
+            record.reservedPlane = 0.;
+        }
+        isWritten = isWritten && writePadded(file, reinterpret_cast<const char*>(records.constData()),
+                                             qint64(records.size())*qint64(sizeof(FaceRecord)));
+    }
+
+    if(!isWritten) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+bool MeshCache::writePadded(QIODevice &Device, const char *Data, qint64 Size)
+{
+    static const char zeros[8] = {0};
+    qint64 padding = getPaddedSize(Size) - Size;
+    return (Size == 0 || Device.write(Data, Size) == Size) &&
+            (padding == 0 || Device.write(zeros, padding) == padding);
+}
+
+// Coordinate3D carries a validity flag, so the pools are converted to plain
+// x y z triples in blocks.
+bool MeshCache::writeCoordinates(QIODevice &Device, const QVector<Coordinate3D> &Coordinates)
+{
+    const int blockSize = 1 << 16;
+    QVector<double> block;
+    for(int first=0; first<Coordinates.size(); first+=blockSize) {
+        int count = qMin(blockSize, Coordinates.size() - first);
+        block.resize(3*count);
+        for(int i=0; i<count; i++) {
+            block[3*i] = Coordinates[first+i].x;
+            block[3*i+1] = Coordinates[first+i].y;
+            block[3*i+2] = Coordinates[first+i].z;
+        }
+        qint64 size = qint64(block.size())*qint64(sizeof(double));
+        if(Device.write(reinterpret_cast<const char*>(block.constData()), size) != size)
+            return false;
+    }
+    return true;
+}
+
+qint64 MeshCache::getPaddedSize(qint64 Size)
+{
+    return (Size + 7) & ~qint64(7);
+}
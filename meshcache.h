@@ -0,0 +1,81 @@
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <QString>
+#include <QVector>
+#include <QIODevice>
+#include <QFileInfo>
+
+#include "wavefront.h"
+
+// Binary copy of the parsed objects of an obj file: names, vertex and
+// normal pools, index buffers and triangles including their bounds and
+// planes. The cache records the size and modification time of its obj file
+// and is only used while both still match.
+//
+// Layout, native byte order, every section padded to 8 bytes:
+//   header: magic "W2HMESH", version, byte order mark, source size and
+//           modification time, object count
+//   per object: name length and counts of vertices, normals, indices and
+//           faces, then the name, vertices and normals as x y z doubles,
+//           indices as int32 and faces as firstIndex and normal (int32),
+//           minimum, maximum, plane slope and plane height (doubles).
+// The file is mapped for loading and each section is copied into the
+// object's pools in a single pass, without parsing: indices with memcpy,
+// vertices, normals and faces converted from their records. Loading is not
+// zero-copy. The objects own QVector pools that outlive the mapping, and
+// Coordinate3D keeps a validity flag (32 bytes a vertex) that the file
+// leaves out (24 bytes).
+class MeshCache
+{
+public:
+    // Without a CacheDirectory the cache is written next to the obj file as
+    // <file>.obj.w2hmesh.
+    MeshCache(QString WavefrontFilename, QString CacheDirectory = QString());
+
+    QString getCacheFilename();
+    // Returns false if there is no valid, up to date cache.
+    bool load(QVector<WavefrontObject> &Objects);
+    bool save(const QVector<WavefrontObject> &Objects);
+
+private:
+    struct Header {
+        char magic[8];
+        quint32 version;
+        quint32 byteOrder;
+        qint64 sourceSize;
+        qint64 sourceModified;
+        qint64 objectCount;
+    };
+
+    struct ObjectHeader {
+        qint32 nameLength;
+        qint32 vertexCount;
+        qint32 normalCount;
+        qint32 indexCount;
+        qint32 faceCount;
+        qint32 reserved;
+    };
+
+    struct FaceRecord {
+        qint32 firstIndex;
+        qint32 normal;
+        double minimum[2];
+        double maximum[2];
+        double planeSlope[2];
+        double planeHeight;
+        double reservedPlane;
+    };
+
+    static const quint32 version = 3;
+    static const quint32 byteOrderMark = 0x01020304;
+
+    static bool writePadded(QIODevice &Device, const char *Data, qint64 Size);
+    static bool writeCoordinates(QIODevice &Device, const QVector<Coordinate3D> &Coordinates);
+    static qint64 getPaddedSize(qint64 Size);
+
+    QFileInfo source;
+    QString cacheFilename;
+};
+
+#endif // MESHCACHE_H
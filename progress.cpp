@@ -0,0 +1,78 @@
+#include "progress.h"
+
+RenderProgress::RenderProgress()
+{
+    clock.start();
+    done.store(0);
+    total.store(0);
+    startTime.store(0);
+}
+
+void RenderProgress::start(qint64 Total)
+{
+    total.store(Total);
+    done.store(0);
+    startTime.store(clock.elapsed());
+}
+
+void RenderProgress::add(qint64 Count)
+{
+    done.fetchAndAddRelaxed(Count);
+}
+
+qint64 RenderProgress::getDone() const
+{
+    return done.load();
+}
+
+qint64 RenderProgress::getTotal() const
+{
+    return total.load();
+}
+
+double RenderProgress::getPercentage() const
+{
+    qint64 totalCount = total.load();
+    if(totalCount <= 0)
+        return 0.;
+    // Estimated totals may fall a little short, e.g. for supersampled faces.
+    return qMin(double(done.load())/double(totalCount)*100., 100.);
+}
+
+qint64 RenderProgress::getElapsed() const
+{
+    return clock.elapsed() - startTime.load();
+}
+
+ProgressReporter::ProgressReporter(const RenderProgress *Progress, ProgressCallback Callback, int Interval)
+{
+    progress = Progress;
+    callback = Callback;
+    interval = Interval;
+    isStopping = false;
+}
+
+ProgressReporter::~ProgressReporter()
+{
+    stop();
+}
+
+void ProgressReporter::stop()
+{
+    mutex.lock();
+    isStopping = true;
+    stopped.wakeAll();
+    mutex.unlock();
+    wait();
+}
+
+void ProgressReporter::run()
+{
+    QMutexLocker locker(&mutex);
+    while(!isStopping) {
+        stopped.wait(&mutex, interval);
+        if(isStopping)
+            break;
+        callback(*progress);
+    }
+}
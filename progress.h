@@ -0,0 +1,58 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <functional>
+
+// Progress of a render as a pair of lock-free counters. Rendering threads
+// add the work they finished, typically once per face; any thread may read.
+class RenderProgress
+{
+public:
+    RenderProgress();
+
+    void start(qint64 Total);
+    void add(qint64 Count);
+
+    qint64 getDone() const;
+    qint64 getTotal() const;
+    double getPercentage() const;
+    qint64 getElapsed() const; // Milliseconds since start().
+
+private:
+    QAtomicInteger<qint64> done;
+    QAtomicInteger<qint64> total;
+    QAtomicInteger<qint64> startTime;
+    QElapsedTimer clock;
+};
+
+typedef std::function<void(const RenderProgress &Progress)> ProgressCallback;
+
+// Calls a callback with the current progress at a fixed interval, on its own
+// thread, until stop() is called. No event loop is involved.
+class ProgressReporter : public QThread
+{
+public:
+    ProgressReporter(const RenderProgress *Progress, ProgressCallback Callback, int Interval = 1000);
+    ~ProgressReporter();
+
+    void stop();
+
+protected:
+    void run();
+
+private:
+    const RenderProgress *progress;
+    ProgressCallback callback;
+    int interval;
+
+    QMutex mutex;
+    QWaitCondition stopped;
+    bool isStopping;
+};
+
+#endif // PROGRESS_H
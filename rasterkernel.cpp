@@ -0,0 +1,277 @@
+#include "rasterkernel.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SPANKERNEL_X86
+#include <immintrin.h>
+#endif
+
+static int fillScalar(double *Depth, int Count, double Start, double Step, int Offset)
+{
+    int writes = 0;
+    for(int i=0; i<Count; i++) {
+        double z = Start + double(Offset+i)*Step;
+        if(z > Depth[i]) {
+            Depth[i] = z;
+            writes++;
+        }
+    }
+    return writes;
+}
+
+static int fillScalarOwners(double *Depth, int *Owners, int Count, double Start, double Step, int Offset, int Owner)
+{
+    int writes = 0;
+    for(int i=0; i<Count; i++) {
+        double z = Start + double(Offset+i)*Step;
+        if(z > Depth[i]) {
+            Depth[i] = z;
+            Owners[i] = Owner;
+            writes++;
+        }
+    }
+    return writes;
+}
+
+#ifdef SPANKERNEL_X86
+static const int shortSpan = 6;
+
+// Only compiled for the given instruction sets, so the rest of the program
+// still runs on any x86 processor. The targets leave out FMA on purpose.
+__attribute__((target("avx2")))
+static int fillAvx2(double *Depth, int Count, double Start, double Step, int Offset)
+{
+    // Setting up the vectors costs more than short spans take.
+    if(Count < shortSpan)
+        return fillScalar(Depth, Count, Start, Step, Offset);
+    int writes = 0;
+    int i = 0;
+    __m256d start = _mm256_set1_pd(Start);
+    __m256d step = _mm256_set1_pd(Step);
+    __m256d index = _mm256_set_pd(double(Offset+3), double(Offset+2), double(Offset+1), double(Offset));
+    __m256d four = _mm256_set1_pd(4.);
+    for(; i+4<=Count; i+=4) {
+        __m256d z = _mm256_add_pd(start, _mm256_mul_pd(index, step));
+        __m256d above = _mm256_cmp_pd(z, _mm256_loadu_pd(Depth+i), _CMP_GT_OQ);
+        _mm256_maskstore_pd(Depth+i, _mm256_castpd_si256(above), z);
+        writes += __builtin_popcount(_mm256_movemask_pd(above));
+        index = _mm256_add_pd(index, four);
+    }
+    return writes + fillScalar(Depth+i, Count-i, Start, Step, Offset+i);
+}
+
+__attribute__((target("avx2")))
+static int fillAvx2Owners(double *Depth, int *Owners, int Count, double Start, double Step, int Offset, int Owner)
+{
+    if(Count < shortSpan)
+        return fillScalarOwners(Depth, Owners, Count, Start, Step, Offset, Owner);
+    int writes = 0;
+    int i = 0;
+    __m256d start = _mm256_set1_pd(Start);
+    __m256d step = _mm256_set1_pd(Step);
+    __m256d index = _mm256_set_pd(double(Offset+3), double(Offset+2), double(Offset+1), double(Offset));
+    __m256d four = _mm256_set1_pd(4.);
+    __m128i owner = _mm_set1_epi32(Owner);
+    // Picks the low halves of the four 64-bit lanes of a mask.
+    __m256i halves = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    for(; i+4<=Count; i+=4) {
+        __m256d z = _mm256_add_pd(start, _mm256_mul_pd(index, step));
+        __m256d above = _mm256_cmp_pd(z, _mm256_loadu_pd(Depth+i), _CMP_GT_OQ);
+        _mm256_maskstore_pd(Depth+i, _mm256_castpd_si256(above), z);
+        __m128i owned = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(_mm256_castpd_si256(above), halves));
+        _mm_maskstore_epi32(Owners+i, owned, owner);
+        writes += __builtin_popcount(_mm256_movemask_pd(above));
+        index = _mm256_add_pd(index, four);
+    }
+    return writes + fillScalarOwners(Depth+i, Owners+i, Count-i, Start, Step, Offset+i, Owner);
+}
+
+__attribute__((target("avx512f")))
+static int fillAvx512(double *Depth, int Count, double Start, double Step, int Offset)
+{
+    if(Count < shortSpan)
+        return fillScalar(Depth, Count, Start, Step, Offset);
+    int writes = 0;
+    __m512d start = _mm512_set1_pd(Start);
+    __m512d step = _mm512_set1_pd(Step);
+    __m512d index = _mm512_set_pd(double(Offset+7), double(Offset+6), double(Offset+5), double(Offset+4),
+                                  double(Offset+3), double(Offset+2), double(Offset+1), double(Offset));
+    __m512d eight = _mm512_set1_pd(8.);
+    for(int i=0; i<Count; i+=8) {
+        // The last block only touches the pixels left in the span.
+        __mmask8 inside = Count-i >= 8 ? __mmask8(0xff) : __mmask8((1u << (Count-i)) - 1);
+        // The rounding forms are never contracted into an FMA.
+        __m512d z = _mm512_maskz_add_round_pd(inside, start,
+                                              _mm512_maskz_mul_round_pd(inside, index, step, _MM_FROUND_CUR_DIRECTION),
+                                              _MM_FROUND_CUR_DIRECTION);
+        __m512d old = _mm512_maskz_loadu_pd(inside, Depth+i);
+        __mmask8 above = _mm512_mask_cmp_pd_mask(inside, z, old, _CMP_GT_OQ);
+        _mm512_mask_storeu_pd(Depth+i, above, z);
+        writes += __builtin_popcount(above);
+        index = _mm512_add_pd(index, eight);
+    }
+    return writes;
+}
+
+__attribute__((target("avx512f")))
+static int fillAvx512Owners(double *Depth, int *Owners, int Count, double Start, double Step, int Offset, int Owner)
+{
+    if(Count < shortSpan)
+        return fillScalarOwners(Depth, Owners, Count, Start, Step, Offset, Owner);
+    int writes = 0;
+    __m512d start = _mm512_set1_pd(Start);
+    __m512d step = _mm512_set1_pd(Step);
+    __m512d index = _mm512_set_pd(double(Offset+7), double(Offset+6), double(Offset+5), double(Offset+4),
+                                  double(Offset+3), double(Offset+2), double(Offset+1), double(Offset));
+    __m512d eight = _mm512_set1_pd(8.);
+    __m512i owner = _mm512_set1_epi32(Owner);
+    for(int i=0; i<Count; i+=8) {
+        __mmask8 inside = Count-i >= 8 ? __mmask8(0xff) : __mmask8((1u << (Count-i)) - 1);
+        __m512d z = _mm512_maskz_add_round_pd(inside, start,
+                                              _mm512_maskz_mul_round_pd(inside, index, step, _MM_FROUND_CUR_DIRECTION),
+                                              _MM_FROUND_CUR_DIRECTION);
+        __m512d old = _mm512_maskz_loadu_pd(inside, Depth+i);
+        __mmask8 above = _mm512_mask_cmp_pd_mask(inside, z, old, _CMP_GT_OQ);
+        _mm512_mask_storeu_pd(Depth+i, above, z);
+        // Only the first eight of the sixteen owner lanes can be selected.
+        _mm512_mask_storeu_epi32(Owners+i, __mmask16(above), owner);
+        writes += __builtin_popcount(above);
+        index = _mm512_add_pd(index, eight);
+    }
+    return writes;
+}
+#endif
+
+SpanKernel::Kind SpanKernel::kind = SpanKernel::getBestKind();
+SpanKernel::Function SpanKernel::function = SpanKernel::getFunction(SpanKernel::kind);
+SpanKernel::OwnerFunction SpanKernel::ownerFunction = SpanKernel::getOwnerFunction(SpanKernel::kind);
+
+SpanKernel::Function SpanKernel::get()
+{
+    return function;
+}
+
+SpanKernel::OwnerFunction SpanKernel::getWithOwners()
+{
+    return ownerFunction;
+}
+
+int SpanKernel::fillLayers(double *Depth, int *Owners, double *Bottoms, int *Counts, float *Slopes, int Count,
+                           double Start, double Step, int Offset, int Owner, float Slope)
+{
+    int writes = 0;
+    for(int i=0; i<Count; i++) {
+        double z = Start + double(Offset+i)*Step;
+        if(Bottoms && z < Bottoms[i])
+            Bottoms[i] = z;
+        if(Counts)
+            Counts[i]++;
+        if(z > Depth[i]) {
+            Depth[i] = z;
+            if(Owners)
+                Owners[i] = Owner;
+            if(Slopes)
+                Slopes[i] = Slope;
+            writes++;
+        }
+    }
+    return writes;
+}
+
+bool SpanKernel::select(Kind Type)
+{
+    if(Type == AutomaticKernel)
+        Type = getBestKind();
+    if(!isSupported(Type))
+        return false;
+    kind = Type;
+    function = getFunction(Type);
+    ownerFunction = getOwnerFunction(Type);
+    return true;
+}
+
+SpanKernel::Kind SpanKernel::getKind()
+{
+    return kind;
+}
+
+bool SpanKernel::isSupported(Kind Type)
+{
+#ifdef SPANKERNEL_X86
+    // Also called from static initialization, possibly ahead of libgcc's.
+    __builtin_cpu_init();
+#endif
+    switch(Type) {
+    case AutomaticKernel:
+    case ScalarKernel:
+        return true;
+#ifdef SPANKERNEL_X86
+    case Avx2Kernel:
+        return __builtin_cpu_supports("avx2");
+    case Avx512Kernel:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+}
+
+SpanKernel::Function SpanKernel::getFunction(Kind Type)
+{
+    if(Type == AutomaticKernel)
+        Type = getBestKind();
+#ifdef SPANKERNEL_X86
+    if(Type == Avx2Kernel)
+        return fillAvx2;
+    if(Type == Avx512Kernel)
+        return fillAvx512;
+#endif
+    return fillScalar;
+}
+
+SpanKernel::OwnerFunction SpanKernel::getOwnerFunction(Kind Type)
+{
+    if(Type == AutomaticKernel)
+        Type = getBestKind();
+#ifdef SPANKERNEL_X86
+    if(Type == Avx2Kernel)
+        return fillAvx2Owners;
+    if(Type == Avx512Kernel)
+        return fillAvx512Owners;
+#endif
+    return fillScalarOwners;
+}
+
+QString SpanKernel::getName(Kind Type)
+{
+    switch(Type) {
+    case AutomaticKernel:
+        return "auto";
+    case ScalarKernel:
+        return "scalar";
+    case Avx2Kernel:
+        return "avx2";
+    case Avx512Kernel:
+        return "avx512";
+    default:
+        return QString();
+    }
+}
+
+SpanKernel::Kind SpanKernel::getKind(QString Name)
+{
+    Name = Name.toLower();
+    for(int i=AutomaticKernel; i<UnknownKernel; i++) {
+        if(Name == getName(Kind(i)))
+            return Kind(i);
+    }
+    return UnknownKernel;
+}
+
+SpanKernel::Kind SpanKernel::getBestKind()
+{
+    if(isSupported(Avx512Kernel))
+        return Avx512Kernel;
+    if(isSupported(Avx2Kernel))
+        return Avx2Kernel;
+    return ScalarKernel;
+}
@@ -0,0 +1,54 @@
+#ifndef RASTERKERNEL_H
+#define RASTERKERNEL_H
+
+#include <QString>
+
+// The inner loop of the rasterizer: raising a span of a height row to the
+// plane of a face. The fastest implementation the processor supports is
+// picked at runtime; all of them compute every height as
+// Start + double(Offset+i)*Step without fused multiply-adds, so they write
+// bit-identical rows.
+class SpanKernel
+{
+public:
+    enum Kind {
+        AutomaticKernel, // The best supported one.
+        ScalarKernel,
+        Avx2Kernel,
+        Avx512Kernel,
+        UnknownKernel
+    };
+
+    // Sets Depth[i] for i in [0, Count) to Start + double(Offset+i)*Step
+    // where that is above it and returns the number of pixels written.
+    typedef int (*Function)(double *Depth, int Count, double Start, double Step, int Offset);
+    // The same, also setting Owners[i] to Owner for every pixel written.
+    typedef int (*OwnerFunction)(double *Depth, int *Owners, int Count, double Start, double Step, int Offset, int Owner);
+
+    static Function get();
+    static OwnerFunction getWithOwners();
+    // The same heights as Function, also keeping the further channels of a
+    // Grid, see Grid::Channel: Bottoms[i] is lowered to every height,
+    // Counts[i] counts the faces and Owners[i] and Slopes[i] follow the
+    // highest one. Any of them may be null. Scalar for every kernel.
+    static int fillLayers(double *Depth, int *Owners, double *Bottoms, int *Counts, float *Slopes, int Count,
+                          double Start, double Step, int Offset, int Owner, float Slope);
+    // Not to be called while rendering. False if the processor lacks Type.
+    static bool select(Kind Type);
+    static Kind getKind();
+    static bool isSupported(Kind Type);
+
+    static Function getFunction(Kind Type);
+    static OwnerFunction getOwnerFunction(Kind Type);
+    static QString getName(Kind Type);
+    static Kind getKind(QString Name);
+
+private:
+    static Kind getBestKind();
+
+    static Kind kind;
+    static Function function;
+    static OwnerFunction ownerFunction;
+};
+
+#endif // RASTERKERNEL_H
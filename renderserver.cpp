@@ -0,0 +1,326 @@
+#include "renderserver.h"
+
+#include <QFileInfo>
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QElapsedTimer>
+#include <QThread>
+#include <string>
+
+RenderServer::RenderServer(int Threads, int MaxMeshes)
+{
+    threads = Threads > 0 ? Threads : QThread::idealThreadCount();
+    maxMeshes = qMax(1, MaxMeshes);
+    rasterMode = Wavefront::EdgeFunctionRaster;
+    heightMode = Wavefront::PlaneHeight;
+    sampleCount = 1;
+    samplePattern = Wavefront::RotatedGridSamples;
+    resolveFilter = Wavefront::MaximumResolve;
+    channels = Grid::HeightChannel;
+    useCache = false;
+    output = 0;
+    isFailed = false;
+    useClock = 0;
+    pool.setMaxThreadCount(threads);
+    tilePool.setMaxThreadCount(threads);
+}
+
+RenderServer::~RenderServer()
+{
+    pool.waitForDone();
+    tilePool.waitForDone();
+    for(int i=0; i<meshes.size(); i++)
+        delete meshes[i]->wavefront;
+    qDeleteAll(meshes);
+}
+
+void RenderServer::setRasterMode(Wavefront::RasterMode Mode)
+{
+    rasterMode = Mode;
+}
+
+void RenderServer::setHeightMode(Wavefront::HeightMode Mode)
+{
+    heightMode = Mode;
+}
+
+void RenderServer::setSampling(int Count, Wavefront::SamplePattern Pattern)
+{
+    sampleCount = Count;
+    samplePattern = Pattern;
+}
+
+void RenderServer::setResolveFilter(Wavefront::ResolveFilter Filter)
+{
+    resolveFilter = Filter;
+}
+
+void RenderServer::setChannels(int Channels)
+{
+    channels = Channels;
+}
+
+void RenderServer::setCache(bool UseCache, QString CacheDirectory)
+{
+    useCache = UseCache;
+    cacheDirectory = CacheDirectory;
+}
+
+bool RenderServer::serve(std::istream &Input, std::ostream &Output)
+{
+    output = &Output;
+    isFailed = false;
+    std::string line;
+    while(std::getline(Input, line)) {
+        QByteArray request = QByteArray(line.c_str()).trimmed();
+        if(request.isEmpty())
+            continue;
+        pool.start(new RenderRequestTask(this, request));
+    }
+    pool.waitForDone();
+    return !isFailed;
+}
+
+void RenderServer::handleRequest(QByteArray Line)
+{
+    QElapsedTimer timer;
+    timer.start();
+    QJsonObject response;
+    QJsonParseError parseError;
+    QJsonDocument document = QJsonDocument::fromJson(Line, &parseError);
+    if(!document.isObject()) {
+        response.insert("succeeded", false);
+        response.insert("error", QString("Invalid request: %1.").arg(parseError.errorString()));
+        respond(response);
+        return;
+    }
+    QJsonObject request = document.object();
+    if(request.contains("id"))
+        response.insert("id", request.value("id"));
+
+    HeatmapJob job;
+    QString input;
+    QString error;
+    if(!getJob(request, job, input, error)) {
+        response.insert("succeeded", false);
+        response.insert("error", error);
+        respond(response);
+        return;
+    }
+    response.insert("output", job.outputFilename);
+
+    bool isLoaded = false;
+    Mesh *mesh = acquireMesh(input, isLoaded);
+    if(!mesh) {
+        response.insert("succeeded", false);
+        response.insert("error", QString("Could not read %1.").arg(input));
+        respond(response);
+        return;
+    }
+
+    // The tiles of all requests are rasterized on tilePool.
+    job.isWritten = mesh->wavefront->renderJob(job, threads);
+    releaseMesh(mesh);
+
+    response.insert("succeeded", job.isWritten);
+    if(!job.isWritten)
+        response.insert("error", QString("Could not write %1.").arg(job.outputFilename));
+    response.insert("loaded", isLoaded);
+    response.insert("seconds", double(timer.nsecsElapsed())/1e9);
+    respond(response);
+}
+
+// The request's keys are mapped onto the options of a job manifest line,
+// see HeatmapJob::readManifest.
+bool RenderServer::getJob(const QJsonObject &Request, HeatmapJob &Job, QString &Input, QString &Error)
+{
+    // format goes last, so that it wins over the extension of output.
+    static const char *const keys[][2] = {
+        {"pixelCount", "-c"}, {"precision", "-p"}, {"output", "-o"},
+        {"crop", "--crop"}, {"maxMemory", "--max-memory"}, {"format", "--format"}
+    };
+    const int keyCount = sizeof(keys)/sizeof(keys[0]);
+
+    QStringList names = Request.keys();
+    for(int i=0; i<names.size(); i++) {
+        bool isKnown = names[i] == "id" || names[i] == "input";
+        for(int k=0; k<keyCount && !isKnown; k++)
+            isKnown = names[i] == keys[k][0];
+        if(!isKnown) {
+            Error = QString("Unknown key %1.").arg(names[i]);
+            return false;
+        }
+    }
+
+    Input = Request.value("input").toString();
+    if(Input.isEmpty()) {
+        Error = "No input file.";
+        return false;
+    }
+    for(int k=0; k<keyCount; k++) {
+        QJsonValue value = Request.value(keys[k][0]);
+        if(value.isUndefined())
+            continue;
+        QString text;
+        if(value.isString()) {
+            text = value.toString();
+        }
+        else if(value.isDouble()) {
+            text = QString::number(value.toDouble(), 'g', 17);
+        }
+        else if(value.isArray()) {
+            QJsonArray values = value.toArray();
+            for(int i=0; i<values.size(); i++)
+                text += (i > 0 ? "," : "") + QString::number(values[i].toDouble(), 'g', 17);
+        }
+        if(text.isEmpty() || !Job.setOption(keys[k][1], text)) {
+            Error = QString("Invalid %1.").arg(keys[k][0]);
+            return false;
+        }
+    }
+    if(Job.outputFilename.isEmpty()) {
+        Error = "No output file.";
+        return false;
+    }
+    if(!(Job.precision > 0.) && Job.pixelCount <= 0) {
+        Error = "Neither pixelCount nor precision.";
+        return false;
+    }
+    if(Job.hasCrop && Job.maxMemory > 0) {
+        Error = "A crop can not be combined with maxMemory.";
+        return false;
+    }
+    return true;
+}
+
+// Requests for a mesh that is still being read wait for it instead of
+// reading it a second time.
+RenderServer::Mesh *RenderServer::acquireMesh(QString Filename, bool &IsLoaded)
+{
+    QFileInfo file(Filename);
+    if(!file.isFile() || !file.isReadable())
+        return 0;
+    QString filename = file.absoluteFilePath();
+    qint64 size = file.size();
+    qint64 modified = file.lastModified().toMSecsSinceEpoch();
+
+    QMutexLocker locker(&meshMutex);
+    Mesh *mesh = 0;
+    for(int i=0; i<meshes.size() && !mesh; i++) {
+        if(meshes[i]->isStale || meshes[i]->filename != filename)
+            continue;
+        if(meshes[i]->size == size && meshes[i]->modified == modified)
+            mesh = meshes[i];
+        else
+            meshes[i]->isStale = true;
+    }
+    if(mesh) {
+        mesh->users++;
+        mesh->lastUse = ++useClock;
+        while(mesh->isLoading)
+            meshLoaded.wait(&meshMutex);
+        // The mesh could not be read, see below.
+        if(!mesh->wavefront) {
+            mesh->users--;
+            evictMeshes();
+            return 0;
+        }
+        IsLoaded = false;
+        return mesh;
+    }
+
+    mesh = new Mesh();
+    mesh->filename = filename;
+    mesh->size = size;
+    mesh->modified = modified;
+    mesh->wavefront = 0;
+    mesh->users = 1;
+    mesh->lastUse = ++useClock;
+    mesh->isLoading = true;
+    mesh->isStale = false;
+    meshes.append(mesh);
+    locker.unlock();
+
+    Wavefront *wavefront = new Wavefront(filename, false, useCache, cacheDirectory, threads);
+    wavefront->setRasterMode(rasterMode);
+    wavefront->setHeightMode(heightMode);
+    wavefront->setSampling(sampleCount, samplePattern);
+    wavefront->setResolveFilter(resolveFilter);
+    wavefront->setChannels(channels);
+    wavefront->tilePool = &tilePool;
+
+    QMutexLocker relocker(&meshMutex);
+    mesh->isLoading = false;
+    meshLoaded.wakeAll();
+    // An empty or foreign file parses to no objects and has no extent to
+    // render. The entry is never found again and goes once its waiters
+    // have left it.
+    if(wavefront->getObjectCount() == 0) {
+        delete wavefront;
+        mesh->isStale = true;
+        mesh->users--;
+        evictMeshes();
+        return 0;
+    }
+    mesh->wavefront = wavefront;
+    IsLoaded = true;
+    return mesh;
+}
+
+void RenderServer::releaseMesh(Mesh *mesh)
+{
+    QMutexLocker locker(&meshMutex);
+    mesh->users--;
+    evictMeshes();
+}
+
+void RenderServer::evictMeshes()
+{
+    int count = 0;
+    for(int i=0; i<meshes.size(); i++) {
+        if(!meshes[i]->isStale)
+            count++;
+    }
+    for(;;) {
+        int oldest = -1;
+        for(int i=0; i<meshes.size(); i++) {
+            Mesh *mesh = meshes[i];
+            if(mesh->users > 0 || mesh->isLoading)
+                continue;
+            if(mesh->isStale) {
+                oldest = i;
+                break;
+            }
+            if(count > maxMeshes && (oldest < 0 || mesh->lastUse < meshes[oldest]->lastUse))
+                oldest = i;
+        }
+        if(oldest < 0)
+            return;
+        if(!meshes[oldest]->isStale)
+            count--;
+        delete meshes[oldest]->wavefront;
+        delete meshes[oldest];
+        meshes.remove(oldest);
+    }
+}
+
+void RenderServer::respond(QJsonObject Response)
+{
+    QByteArray line = QJsonDocument(Response).toJson(QJsonDocument::Compact);
+    QMutexLocker locker(&outputMutex);
+    if(!Response.value("succeeded").toBool())
+        isFailed = true;
+    *output << line.constData() << std::endl;
+}
+
+RenderRequestTask::RenderRequestTask(RenderServer *Owner, QByteArray Line)
+{
+    owner = Owner;
+    line = Line;
+}
+
+void RenderRequestTask::run()
+{
+    owner->handleRequest(line);
+}
@@ -0,0 +1,116 @@
+#ifndef RENDERSERVER_H
+#define RENDERSERVER_H
+
+#include <QString>
+#include <QVector>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QThreadPool>
+#include <QRunnable>
+#include <istream>
+#include <ostream>
+
+#include "wavefront.h"
+#include "heatmapjob.h"
+
+// Renders heatmaps on request for as long as it runs. Requests are JSON
+// objects, one per line:
+//   {"id": 7, "input": "terrain.obj", "output": "tile.png", "pixelCount": 500000,
+//    "precision": 0.01, "format": "png16", "crop": [MinX, MinY, MaxX, MaxY],
+//    "maxMemory": "512M"}
+// input and output are required, and one of pixelCount and precision; crop
+// and maxMemory exclude each other. Every
+// request is answered with one line once it is done, in the order they
+// finish:
+//   {"id": 7, "output": "tile.png", "succeeded": true, "loaded": false, "seconds": 0.12}
+// with an "error" instead where it failed. loaded tells whether the mesh
+// had to be read for this request.
+//
+// The parsed meshes of the most recently used obj files stay loaded, keyed
+// by the file's path, size and modification time, so that a changed file
+// is read again; a file without objects is refused and not kept. Requests
+// run side by side, and the tiles of all of them are rasterized on one
+// shared pool of Threads threads.
+class RenderServer
+{
+public:
+    // 0 threads use one per core.
+    RenderServer(int Threads = 0, int MaxMeshes = 4);
+    ~RenderServer();
+
+    // Settings for the meshes loaded from now on.
+    void setRasterMode(Wavefront::RasterMode Mode);
+    void setHeightMode(Wavefront::HeightMode Mode);
+    void setCache(bool UseCache, QString CacheDirectory = QString());
+    void setSampling(int Count, Wavefront::SamplePattern Pattern = Wavefront::RotatedGridSamples);
+    void setResolveFilter(Wavefront::ResolveFilter Filter);
+    void setChannels(int Channels);
+
+    // Reads requests until Input ends and returns once all of them are
+    // answered on Output. Returns false if any request failed.
+    bool serve(std::istream &Input, std::ostream &Output);
+
+private:
+    friend class RenderRequestTask;
+
+    struct Mesh {
+        QString filename;
+        qint64 size;
+        qint64 modified;
+        Wavefront *wavefront;
+        int users;
+        qint64 lastUse;
+        bool isLoading;
+        // The file changed since, so the mesh is dropped once unused.
+        bool isStale;
+    };
+
+    void handleRequest(QByteArray Line);
+    static bool getJob(const QJsonObject &Request, HeatmapJob &Job, QString &Input, QString &Error);
+    Mesh *acquireMesh(QString Filename, bool &IsLoaded);
+    void releaseMesh(Mesh *mesh);
+    // Drops unused meshes beyond maxMeshes, least recently used first.
+    void evictMeshes();
+    void respond(QJsonObject Response);
+
+    int threads;
+    int maxMeshes;
+    Wavefront::RasterMode rasterMode;
+    Wavefront::HeightMode heightMode;
+    int sampleCount;
+    Wavefront::SamplePattern samplePattern;
+    Wavefront::ResolveFilter resolveFilter;
+    int channels;
+    bool useCache;
+    QString cacheDirectory;
+
+    // Requests, and the tile workers of their renders.
+    QThreadPool pool;
+    QThreadPool tilePool;
+    std::ostream *output;
+    QMutex outputMutex;
+    bool isFailed;
+
+    QMutex meshMutex;
+    QWaitCondition meshLoaded;
+    QVector<Mesh*> meshes;
+    qint64 useClock;
+};
+
+
+// Handles one request line of a RenderServer. Deleted by the pool once run.
+class RenderRequestTask : public QRunnable
+{
+public:
+    RenderRequestTask(RenderServer *Owner, QByteArray Line);
+
+    void run();
+
+private:
+    RenderServer *owner;
+    QByteArray line;
+};
+
+#endif // RENDERSERVER_H
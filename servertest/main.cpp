@@ -0,0 +1,97 @@
+#include <QCoreApplication>
+#include <QString>
+#include <QFile>
+#include <QDir>
+#include <QTemporaryFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "renderserver.h"
+
+// Sends the render server requests for an empty obj file next to ones for
+// a valid mesh and fails unless every empty one is refused with "Could not
+// read" and every valid one succeeds.
+
+static bool writeFile(QTemporaryFile &File, const QByteArray &Content)
+{
+    if(!File.open())
+        return false;
+    bool isWritten = File.write(Content) == Content.size();
+    File.close();
+    return isWritten;
+}
+
+static QString getRequest(int Id, QString Input, QString Output)
+{
+    QJsonObject request;
+    request.insert("id", Id);
+    request.insert("input", Input);
+    request.insert("output", Output);
+    request.insert("pixelCount", 10000);
+    request.insert("format", "f32");
+    return QString(QJsonDocument(request).toJson(QJsonDocument::Compact));
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QTemporaryFile empty(QDir::tempPath() + "/WavefrontToHeatmapServerTest-XXXXXX.obj");
+    QTemporaryFile mesh(QDir::tempPath() + "/WavefrontToHeatmapServerTest-XXXXXX.obj");
+    if(!writeFile(empty, QByteArray()) ||
+       !writeFile(mesh, "v 0 0 0\nv 1 0 1\nv 0 1 2\nv 1 1 1\nf 1 2 3\nf 2 4 3\n")) {
+        std::cout << "Could not write the test obj files." << std::endl;
+        return 1;
+    }
+    QString output = QDir::tempPath() + "/WavefrontToHeatmapServerTest-%1.f32";
+
+    // Odd ids ask for the empty file, some of them while it is still being
+    // read for another request; even ids for the valid mesh.
+    const int requestCount = 8;
+    std::string requests;
+    for(int id=1; id<=requestCount; id++) {
+        QString input = id%2 == 1 ? empty.fileName() : mesh.fileName();
+        requests += getRequest(id, input, output.arg(id)).toStdString() + "\n";
+    }
+    std::istringstream input(requests);
+    std::ostringstream responses;
+    RenderServer server(2);
+    bool isServed = server.serve(input, responses);
+
+    int failures = 0;
+    int answered = 0;
+    std::istringstream lines(responses.str());
+    std::string line;
+    while(std::getline(lines, line)) {
+        QJsonObject response = QJsonDocument::fromJson(QByteArray(line.c_str())).object();
+        int id = response.value("id").toInt();
+        bool isEmpty = id%2 == 1;
+        bool isSucceeded = response.value("succeeded").toBool();
+        QString error = response.value("error").toString();
+        answered++;
+        if(isEmpty && (isSucceeded || !error.startsWith("Could not read"))) {
+            std::cout << "The empty obj file was not refused: " << line << std::endl;
+            failures++;
+        }
+        if(!isEmpty && !isSucceeded) {
+            std::cout << "The valid mesh failed: " << line << std::endl;
+            failures++;
+        }
+        QFile::remove(output.arg(id));
+        QFile::remove(QString(output).replace(".f32", ".hdr").arg(id));
+    }
+    if(answered != requestCount) {
+        std::cout << answered << " of " << requestCount << " requests answered." << std::endl;
+        failures++;
+    }
+    // Some requests failed, so the server has to report that.
+    if(isServed) {
+        std::cout << "The server did not report the failed requests." << std::endl;
+        failures++;
+    }
+    std::cout << (failures == 0 ? "All requests answered as expected." : "FAILED.") << std::endl;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,13 @@
+#QT -= gui
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = WavefrontToHeatmapServerTest
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+SOURCES += \
+        main.cpp
+
+include(../wavefront.pri)
@@ -0,0 +1,197 @@
+#include "spatialindex.h"
+#include "statistics.h"
+
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
+SpatialIndex::SpatialIndex()
+{
+    cellSizeX = cellSizeY = 1.;
+    cellsX = cellsY = 0;
+}
+
+void SpatialIndex::build(QVector<WavefrontObject> &Objects)
+{
+    ScopedTimer timer(Statistics::IndexTimer);
+    faces.clear();
+    cellStarts.clear();
+    cellFaces.clear();
+    cellsX = cellsY = 0;
+
+    double maxDouble = std::numeric_limits<double>::max();
+    minimum = Coordinate2D(maxDouble, maxDouble);
+    maximum = Coordinate2D(-maxDouble, -maxDouble);
+    double extent = 0.;
+    for(int i=0; i<Objects.size(); i++) {
+        if(!Objects[i].isActive)
+            continue;
+        for(int j=0; j<Objects[i].faces.size(); j++) {
+            WavefrontFace &face = Objects[i].faces[j];
+            Face entry;
+            entry.object = &Objects[i];
+            entry.face = &face;
+            faces.append(entry);
+
+            Coordinate2D faceMinimum = face.getMinimum();
+            Coordinate2D faceMaximum = face.getMaximum();
+            minimum.x = qMin(minimum.x, faceMinimum.x);
+            minimum.y = qMin(minimum.y, faceMinimum.y);
+            maximum.x = qMax(maximum.x, faceMaximum.x);
+            maximum.y = qMax(maximum.y, faceMaximum.y);
+            extent += qMax(faceMaximum.x - faceMinimum.x, faceMaximum.y - faceMinimum.y);
+        }
+    }
+    if(faces.isEmpty())
+        return;
+
+    // About one face per cell, but cells no smaller than the average face so
+    // that a face rarely lands in more than four of them.
+    double lengthX = maximum.x - minimum.x;
+    double lengthY = maximum.y - minimum.y;
+    double count = double(faces.size());
+    double cellSize = qMax(std::sqrt(lengthX*lengthY/count), extent/count);
+    if(!(cellSize > 0.))
+        cellSize = qMax(qMax(lengthX, lengthY)/count, 1e-12);
+    const double maximumCells = 4096.;
+    cellsX = int(qBound(1., std::ceil(lengthX/cellSize), maximumCells));
+    cellsY = int(qBound(1., std::ceil(lengthY/cellSize), maximumCells));
+    cellSizeX = lengthX > 0. ? lengthX/double(cellsX) : 1.;
+    cellSizeY = lengthY > 0. ? lengthY/double(cellsY) : 1.;
+
+    // Counting pass, prefix sum, then the faces are filled in mesh order.
+    cellStarts.fill(0, cellsX*cellsY + 1);
+    for(int f=0; f<faces.size(); f++) {
+        int firstX = getCellX(faces[f].face->getMinimum().x), lastX = getCellX(faces[f].face->getMaximum().x);
+        int firstY = getCellY(faces[f].face->getMinimum().y), lastY = getCellY(faces[f].face->getMaximum().y);
+        for(int y=firstY; y<=lastY; y++) {
+            for(int x=firstX; x<=lastX; x++)
+                cellStarts[y*cellsX + x + 1]++;
+        }
+    }
+    for(int c=0; c<cellsX*cellsY; c++)
+        cellStarts[c+1] += cellStarts[c];
+
+    cellFaces.resize(cellStarts.last());
+    QVector<int> fill = cellStarts;
+    for(int f=0; f<faces.size(); f++) {
+        int firstX = getCellX(faces[f].face->getMinimum().x), lastX = getCellX(faces[f].face->getMaximum().x);
+        int firstY = getCellY(faces[f].face->getMinimum().y), lastY = getCellY(faces[f].face->getMaximum().y);
+        for(int y=firstY; y<=lastY; y++) {
+            for(int x=firstX; x<=lastX; x++)
+                cellFaces[fill[y*cellsX + x]++] = f;
+        }
+    }
+}
+
+bool SpatialIndex::isEmpty()
+{
+    return faces.isEmpty();
+}
+
+int SpatialIndex::getFaceCount()
+{
+    return faces.size();
+}
+
+QVector<SpatialIndex::Face> SpatialIndex::queryPoint(Coordinate2D Point)
+{
+    QVector<Face> result;
+    if(faces.isEmpty() || std::isnan(Point.x) || std::isnan(Point.y) ||
+       Point.x < minimum.x || Point.x > maximum.x || Point.y < minimum.y || Point.y > maximum.y)
+        return result;
+
+    int cell = getCellY(Point.y)*cellsX + getCellX(Point.x);
+    for(int k=cellStarts[cell]; k<cellStarts[cell+1]; k++) {
+        const Face &entry = faces[cellFaces[k]];
+        Coordinate2D faceMinimum = entry.face->getMinimum();
+        Coordinate2D faceMaximum = entry.face->getMaximum();
+        if(Point.x >= faceMinimum.x && Point.x <= faceMaximum.x && Point.y >= faceMinimum.y && Point.y <= faceMaximum.y)
+            result.append(entry);
+    }
+    return result;
+}
+
+QVector<SpatialIndex::Face> SpatialIndex::queryRectangle(Coordinate2D Minimum, Coordinate2D Maximum)
+{
+    QVector<Face> result;
+    if(faces.isEmpty() || std::isnan(Minimum.x) || std::isnan(Minimum.y) || std::isnan(Maximum.x) || std::isnan(Maximum.y) ||
+       Maximum.x < minimum.x || Minimum.x > maximum.x || Maximum.y < minimum.y || Minimum.y > maximum.y)
+        return result;
+
+    // Faces spanning several cells show up once per cell; sorting the face
+    // numbers removes them and restores the mesh order.
+    QVector<int> found;
+    for(int y=getCellY(Minimum.y); y<=getCellY(Maximum.y); y++) {
+        for(int x=getCellX(Minimum.x); x<=getCellX(Maximum.x); x++) {
+            int cell = y*cellsX + x;
+            for(int k=cellStarts[cell]; k<cellStarts[cell+1]; k++) {
+                const Face &entry = faces[cellFaces[k]];
+                Coordinate2D faceMinimum = entry.face->getMinimum();
+                Coordinate2D faceMaximum = entry.face->getMaximum();
+                if(faceMaximum.x >= Minimum.x && faceMinimum.x <= Maximum.x &&
+                   faceMaximum.y >= Minimum.y && faceMinimum.y <= Maximum.y)
+                    found.append(cellFaces[k]);
+            }
+        }
+    }
+    std::sort(found.begin(), found.end());
+    found.erase(std::unique(found.begin(), found.end()), found.end());
+
+    result.reserve(found.size());
+    for(int k=0; k<found.size(); k++)
+        result.append(faces[found[k]]);
+    return result;
+}
+
+bool SpatialIndex::getHeight(Coordinate2D Point, double &Height)
+{
+    return getTopmostHit(Point, std::numeric_limits<double>::infinity(), Height);
+}
+
+bool SpatialIndex::castRayDown(Coordinate3D Origin, Coordinate3D &Hit)
+{
+    double height;
+    if(!getTopmostHit(Coordinate2D(Origin.x, Origin.y), Origin.z, height))
+        return false;
+    Hit = Coordinate3D(Origin.x, Origin.y, height);
+    return true;
+}
+
+// Clamped before the conversion, so coordinates far off the index do not
+// overflow an int. NaN goes to the first cell.
+int SpatialIndex::getCellX(double X)
+{
+    double cell = std::floor((X - minimum.x)/cellSizeX);
+    if(!(cell > 0.))
+        return 0;
+    return int(qMin(cell, double(cellsX-1)));
+}
+
+int SpatialIndex::getCellY(double Y)
+{
+    double cell = std::floor((Y - minimum.y)/cellSizeY);
+    if(!(cell > 0.))
+        return 0;
+    return int(qMin(cell, double(cellsY-1)));
+}
+
+// Same point-in-polygon test and plane evaluation as the crossing raster mode.
+bool SpatialIndex::getTopmostHit(Coordinate2D Point, double MaximumHeight, double &Height)
+{
+    bool isFound = false;
+    QVector<Face> candidates = queryPoint(Point);
+    for(int k=0; k<candidates.size(); k++) {
+        WavefrontObject &object = *candidates[k].object;
+        const WavefrontFace &face = *candidates[k].face;
+        if(!object.isPointInPolygon(face, Point))
+            continue;
+        Coordinate3D vertex = object.getHeight(face, Point);
+        if(vertex.z > MaximumHeight)
+            continue;
+        if(!isFound || vertex.z > Height)
+            Height = vertex.z;
+        isFound = true;
+    }
+    return isFound;
+}
@@ -0,0 +1,53 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <QVector>
+
+#include "wavefront.h"
+
+// Uniform grid of cells over the xy bounding boxes of the faces of all
+// active objects. Every cell lists the faces whose box overlaps it, in mesh
+// order; the lists of all cells are packed into one array. Built once,
+// read-only afterwards, so queries may run concurrently.
+class SpatialIndex
+{
+public:
+    struct Face {
+        WavefrontObject *object;
+        WavefrontFace *face;
+    };
+
+    SpatialIndex();
+
+    // Objects must not change while the index is in use.
+    void build(QVector<WavefrontObject> &Objects);
+    bool isEmpty();
+    int getFaceCount();
+
+    // Faces whose bounding box contains Point, or overlaps the rectangle
+    // [Minimum, Maximum], in mesh order and without duplicates. None for
+    // NaN coordinates.
+    QVector<Face> queryPoint(Coordinate2D Point);
+    QVector<Face> queryRectangle(Coordinate2D Minimum, Coordinate2D Maximum);
+
+    // Height of the topmost surface at Point. Returns false if no face covers it.
+    bool getHeight(Coordinate2D Point, double &Height);
+    // First surface below Origin along -z. Faces above Origin are ignored.
+    bool castRayDown(Coordinate3D Origin, Coordinate3D &Hit);
+
+private:
+    int getCellX(double X);
+    int getCellY(double Y);
+    bool getTopmostHit(Coordinate2D Point, double MaximumHeight, double &Height);
+
+    QVector<Face> faces;
+    // Faces of cell c are cellFaces[cellStarts[c]] .. cellFaces[cellStarts[c+1]-1].
+    QVector<int> cellStarts;
+    QVector<int> cellFaces;
+
+    Coordinate2D minimum, maximum;
+    double cellSizeX, cellSizeY;
+    int cellsX, cellsY;
+};
+
+#endif // SPATIALINDEX_H
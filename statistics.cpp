@@ -0,0 +1,176 @@
+#include "statistics.h"
+
+QAtomicInt Statistics::enabled(0);
+QAtomicInteger<qint64> Statistics::counters[Statistics::NumberOfCounters];
+QAtomicInteger<qint64> Statistics::times[Statistics::NumberOfTimers];
+QAtomicInteger<qint64> Statistics::calls[Statistics::NumberOfTimers];
+
+static thread_local bool isCountingAllocations = false;
+
+void Statistics::setEnabled(bool IsEnabled)
+{
+    enabled.store(IsEnabled ? 1 : 0);
+}
+
+bool Statistics::isEnabled()
+{
+    return enabled.load() != 0;
+}
+
+void Statistics::reset()
+{
+    for(int i=0; i<NumberOfCounters; i++)
+        counters[i].store(0);
+    for(int i=0; i<NumberOfTimers; i++) {
+        times[i].store(0);
+        calls[i].store(0);
+    }
+}
+
+void Statistics::add(Counter Type, qint64 Count)
+{
+    if(isEnabled())
+        counters[Type].fetchAndAddRelaxed(Count);
+}
+
+void Statistics::countAllocation()
+{
+    if(isCountingAllocations && isEnabled())
+        counters[AllocationsCounter].fetchAndAddRelaxed(1);
+}
+
+void Statistics::addTime(Timer Type, qint64 Nanoseconds)
+{
+    if(!isEnabled())
+        return;
+    times[Type].fetchAndAddRelaxed(Nanoseconds);
+    calls[Type].fetchAndAddRelaxed(1);
+}
+
+qint64 Statistics::getCount(Counter Type)
+{
+    return counters[Type].load();
+}
+
+qint64 Statistics::getTime(Timer Type)
+{
+    return times[Type].load();
+}
+
+qint64 Statistics::getCalls(Timer Type)
+{
+    return calls[Type].load();
+}
+
+QString Statistics::getName(Timer Type)
+{
+    switch(Type) {
+    case ParseTimer:
+        return "parse";
+    case CacheTimer:
+        return "cache";
+    case BoundsTimer:
+        return "bounds";
+    case IndexTimer:
+        return "index";
+    case CountTimer:
+        return "count";
+    case RasterTimer:
+        return "raster";
+    case NormalizeTimer:
+        return "normalize";
+    case EncodeTimer:
+        return "encode";
+    default:
+        return QString();
+    }
+}
+
+QString Statistics::getName(Counter Type)
+{
+    switch(Type) {
+    case FacesCounter:
+        return "faces";
+    case BoundingBoxPixelsCounter:
+        return "boundingBoxPixels";
+    case CoveredPixelsCounter:
+        return "coveredPixels";
+    case WritesCounter:
+        return "writes";
+    case BytesReadCounter:
+        return "bytesRead";
+    case BytesWrittenCounter:
+        return "bytesWritten";
+    case OutputPixelsCounter:
+        return "outputPixels";
+    case AllocationsCounter:
+        return "allocations";
+    default:
+        return QString();
+    }
+}
+
+// Amount per second of the given timers, 0 if they never ran.
+static double getRate(qint64 Amount, qint64 Nanoseconds)
+{
+    return Nanoseconds > 0 ? double(Amount)/(double(Nanoseconds)/1e9) : 0.;
+}
+
+QJsonObject Statistics::toJson()
+{
+    QJsonObject timers;
+    for(int i=0; i<NumberOfTimers; i++) {
+        QJsonObject timer;
+        timer.insert("seconds", double(getTime(Timer(i)))/1e9);
+        timer.insert("calls", getCalls(Timer(i)));
+        timers.insert(getName(Timer(i)), timer);
+    }
+
+    QJsonObject counts;
+    for(int i=0; i<NumberOfCounters; i++)
+        counts.insert(getName(Counter(i)), getCount(Counter(i)));
+
+    QJsonObject throughput;
+    qint64 parseTime = getTime(ParseTimer) + getTime(CacheTimer);
+    qint64 rasterTime = getTime(RasterTimer);
+    qint64 outputTime = getTime(NormalizeTimer) + getTime(EncodeTimer);
+    throughput.insert("readMegabytesPerSecond", getRate(getCount(BytesReadCounter), parseTime)/(1024.*1024.));
+    throughput.insert("rasterFacesPerSecond", getRate(getCount(FacesCounter), rasterTime));
+    throughput.insert("rasterPixelsPerSecond", getRate(getCount(BoundingBoxPixelsCounter), rasterTime));
+    throughput.insert("outputPixelsPerSecond", getRate(getCount(OutputPixelsCounter), outputTime));
+
+    QJsonObject report;
+    report.insert("timers", timers);
+    report.insert("counters", counts);
+    report.insert("throughput", throughput);
+    // Share of the bounding box pixels inside a face, low for slivers.
+    qint64 boundingBoxPixels = getCount(BoundingBoxPixelsCounter);
+    report.insert("coverage", boundingBoxPixels > 0 ? double(getCount(CoveredPixelsCounter))/double(boundingBoxPixels) : 0.);
+    return report;
+}
+
+ScopedTimer::ScopedTimer(Statistics::Timer Type)
+{
+    type = Type;
+    isRunning = Statistics::isEnabled();
+    if(isRunning)
+        clock.start();
+}
+
+ScopedTimer::~ScopedTimer()
+{
+    if(isRunning)
+        Statistics::addTime(type, clock.nsecsElapsed());
+}
+
+AllocationScope::AllocationScope()
+{
+    isOuter = !isCountingAllocations;
+    isCountingAllocations = true;
+}
+
+AllocationScope::~AllocationScope()
+{
+    if(isOuter)
+        isCountingAllocations = false;
+}
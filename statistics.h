@@ -0,0 +1,100 @@
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QString>
+
+// Process-wide timers and counters of the pipeline stages, to tell which
+// stage is the bottleneck of a job. Recording is off until setEnabled(true);
+// while it is off the timers never read the clock and nothing is added.
+//
+// A timer adds up the time every thread spends in its stage, so stages that
+// run side by side (batch jobs, pyramid tiles) can exceed the wall time.
+// Rendering threads add their counts once per face, like RenderProgress.
+class Statistics
+{
+public:
+    enum Timer {
+        ParseTimer,     // Reading the obj file, including the face bounding boxes.
+        CacheTimer,     // Loading or writing the mesh cache.
+        BoundsTimer,    // The mesh extent.
+        IndexTimer,     // Building the spatial index.
+        CountTimer,     // Collecting the faces of a render and counting its iterations.
+        RasterTimer,    // Rasterizing and merging tiles.
+        NormalizeTimer, // Height ranges and turning rows into output samples.
+        EncodeTimer,    // Compressing and writing the output files.
+        NumberOfTimers
+    };
+
+    enum Counter {
+        FacesCounter,             // Faces rasterized, once per tile or band they overlap.
+        BoundingBoxPixelsCounter, // Pixels within those faces' bounding boxes.
+        CoveredPixelsCounter,     // Pixels found inside a face.
+        WritesCounter,            // Depth buffer writes, i.e. covered pixels that were on top.
+        BytesReadCounter,         // Obj and cache files.
+        BytesWrittenCounter,      // Output files, without the mesh cache.
+        OutputPixelsCounter,      // Pixels written to output files.
+        AllocationsCounter,       // Heap allocations within an AllocationScope, if the program counts them.
+        NumberOfCounters
+    };
+
+    static void setEnabled(bool IsEnabled);
+    static bool isEnabled();
+    static void reset();
+
+    static void add(Counter Type, qint64 Count);
+    static void addTime(Timer Type, qint64 Nanoseconds);
+    static qint64 getCount(Counter Type);
+    static qint64 getTime(Timer Type);
+    static qint64 getCalls(Timer Type);
+
+    // Called by the allocation hooks of a program (allocationcounter.cpp)
+    // for every heap allocation; counts it if the calling thread is within
+    // an AllocationScope. Must not allocate itself.
+    static void countAllocation();
+
+    // Keys of the report, e.g. "parse" or "coveredPixels".
+    static QString getName(Timer Type);
+    static QString getName(Counter Type);
+
+    // {"timers": {name: {"seconds", "calls"}}, "counters": {name: count},
+    //  "throughput": {...}, "coverage": covered/bounding box pixels}
+    static QJsonObject toJson();
+
+private:
+    static QAtomicInt enabled;
+    static QAtomicInteger<qint64> counters[NumberOfCounters];
+    static QAtomicInteger<qint64> times[NumberOfTimers];
+    static QAtomicInteger<qint64> calls[NumberOfTimers];
+};
+
+
+// Marks the steady-state loop of the calling thread, e.g. rasterizing the
+// faces of a render, whose allocations go to the allocations counter.
+class AllocationScope
+{
+public:
+    AllocationScope();
+    ~AllocationScope();
+
+private:
+    bool isOuter;
+};
+
+
+// Adds the time from its construction to its destruction to a timer.
+class ScopedTimer
+{
+public:
+    ScopedTimer(Statistics::Timer Type);
+    ~ScopedTimer();
+
+private:
+    Statistics::Timer type;
+    bool isRunning;
+    QElapsedTimer clock;
+};
+
+#endif // STATISTICS_H
@@ -1,4 +1,18 @@
 #include "wavefront.h"
+#include "wavefrontreader.h"
+#include "spatialindex.h"
+#include "meshcache.h"
+#include "heatmapjob.h"
+#include "statistics.h"
+#include "rasterkernel.h"
+
+#include <QFileInfo>
+#include <QHash>
+
+// Height of pixels no face has been drawn to.
+static const double emptyHeight = -std::numeric_limits<double>::infinity();
+// Owner of kept pixels whose object changed, until they are rendered again.
+static const int dirtyOwner = -2;
 
 Coordinate3D::Coordinate3D()
 {
@@ -35,64 +49,74 @@ Coordinate2D::Coordinate2D(double X, double Y)
 
 WavefrontFace::WavefrontFace()
 {
-    normal = Coordinate3D();
+    firstIndex = 0;
+    normal = -1;
+    planeHeight = 0.;
 }
 
 Coordinate2D WavefrontFace::getMinimum()
 {
-    double maxDouble = 9999999.;
-    Coordinate2D minimum = Coordinate2D(maxDouble,maxDouble);
-    for(int i=0; i<vertices.size(); i++) {
-        if(minimum.x > vertices[i].x)
-            minimum.x = vertices[i].x;
-        if(minimum.y > vertices[i].y)
-            minimum.y = vertices[i].y;
-    }
     return minimum;
 }
 
 Coordinate2D WavefrontFace::getMaximum()
 {
-    double minDouble = -9999999.;
-    Coordinate2D maximum = Coordinate2D(minDouble,minDouble);
-    for(int i=0; i<vertices.size(); i++) {
-        if(maximum.x < vertices[i].x)
-            maximum.x = vertices[i].x;
-        if(maximum.y < vertices[i].y)
-            maximum.y = vertices[i].y;
-    }
     return maximum;
 }
 
-bool WavefrontFace::isPointInPolygon(Coordinate2D Point)
+double WavefrontFace::getHeight(Coordinate2D Point) const
 {
-    int i, j, nvert = vertices.size();
-    bool c = false;
+    return planeHeight + planeSlope.x*(Point.x-minimum.x) + planeSlope.y*(Point.y-minimum.y);
+}
 
-    for(i = 0, j = nvert - 1; i < nvert; j = i++) {
-        if( ( (vertices[i].y >= Point.y ) != (vertices[j].y >= Point.y) ) &&
-            (Point.x <= (vertices[j].x - vertices[i].x) * (Point.y - vertices[i].y) / (vertices[j].y - vertices[i].y) + vertices[i].x)
-          )
-          c = !c;
-    }
+Coordinate2D WavefrontFace::getPlaneSlope() const
+{
+    return planeSlope;
+}
 
-    return c;
+double WavefrontFace::getSlopeAngle() const
+{
+    return std::atan(std::sqrt(planeSlope.x*planeSlope.x + planeSlope.y*planeSlope.y))*180./M_PI;
 }
 
-Coordinate3D WavefrontFace::getHeight(Coordinate2D Point)
+TriangleEdge::TriangleEdge(Coordinate2D P, Coordinate2D Q)
 {
-    Coordinate3D vertex = Coordinate3D(Point.x, Point.y, 0);
-    if(normal.z == 0.) {
-        vertex.isValid = false;
-        return vertex;
+    if(P.x < Q.x || (P.x == Q.x && P.y < Q.y)) {
+        origin = P;
+        direction = Coordinate2D(Q.x-P.x, Q.y-P.y);
+        sign = 1.;
     }
     else {
-        double X = (vertices[0].x-vertex.x)*normal.x;
-        double Y = (vertices[0].y-vertex.y)*normal.y;
-        vertex.z = vertices[0].z+(X + Y)/normal.z;
-        vertex.isValid = true;
-        return vertex;
+        origin = Q;
+        direction = Coordinate2D(P.x-Q.x, P.y-Q.y);
+        sign = -1.;
     }
+
+    // Left/bottom rule, see wavefront.h. Expressed in terms of P->Q.
+    double dx = Q.x - P.x;
+    double dy = Q.y - P.y;
+    ownsBoundary = dy < 0. || (dy == 0. && dx > 0.);
+}
+
+double TriangleEdge::evaluate(Coordinate2D Point) const
+{
+    return sign*(direction.x*(Point.y-origin.y) - direction.y*(Point.x-origin.x));
+}
+
+bool TriangleEdge::contains(Coordinate2D Point) const
+{
+    double e = evaluate(Point);
+    return e > 0. || (e == 0. && ownsBoundary);
+}
+
+double TriangleEdge::getSlopeX() const
+{
+    return -sign*direction.y;
+}
+
+double TriangleEdge::getCrossingX(double Y) const
+{
+    return origin.x + direction.x*(Y-origin.y)/direction.y;
 }
 
 WavefrontObject::WavefrontObject()
@@ -101,377 +125,2044 @@ WavefrontObject::WavefrontObject()
     isActive = true;
 }
 
-Wavefront::Wavefront(QString Filename, bool commandLineOutput)
+Coordinate3D WavefrontObject::getVertex(const WavefrontFace &Face, int K)
+{
+    return vertices[indices[Face.firstIndex+K]];
+}
+
+Coordinate3D WavefrontObject::getNormal(const WavefrontFace &Face)
+{
+    if(Face.normal < 0)
+        return Coordinate3D();
+    return normals[Face.normal];
+}
+
+void WavefrontObject::updateBounds(WavefrontFace &Face)
+{
+    double maxDouble = 9999999.;
+    Face.minimum = Coordinate2D(maxDouble,maxDouble);
+    Face.maximum = Coordinate2D(-maxDouble,-maxDouble);
+    for(int k=0; k<Face.vertexCount; k++) {
+        const Coordinate3D &vertex = vertices[indices[Face.firstIndex+k]];
+        if(Face.minimum.x > vertex.x)
+            Face.minimum.x = vertex.x;
+        if(Face.minimum.y > vertex.y)
+            Face.minimum.y = vertex.y;
+        if(Face.maximum.x < vertex.x)
+            Face.maximum.x = vertex.x;
+        if(Face.maximum.y < vertex.y)
+            Face.maximum.y = vertex.y;
+    }
+}
+
+bool WavefrontObject::updatePlane(WavefrontFace &Face)
+{
+    // Relative to the first corner, which keeps far away meshes precise.
+    Coordinate3D origin = getVertex(Face, 0);
+    double normalX = 0., normalY = 0., normalZ = 0.;
+    double centerX = 0., centerY = 0., centerZ = 0.;
+    for(int k=0; k<Face.vertexCount; k++) {
+        Coordinate3D a = getVertex(Face, k);
+        Coordinate3D b = getVertex(Face, (k+1)%Face.vertexCount);
+        a = Coordinate3D(a.x-origin.x, a.y-origin.y, a.z-origin.z);
+        b = Coordinate3D(b.x-origin.x, b.y-origin.y, b.z-origin.z);
+        normalX += (a.y-b.y)*(a.z+b.z);
+        normalY += (a.z-b.z)*(a.x+b.x);
+        normalZ += (a.x-b.x)*(a.y+b.y);
+        centerX += a.x;
+        centerY += a.y;
+        centerZ += a.z;
+    }
+    if(normalZ == 0. || normalZ != normalZ)
+        return false;
+
+    double count = double(Face.vertexCount);
+    Face.planeSlope = Coordinate2D(-normalX/normalZ, -normalY/normalZ);
+    Face.planeHeight = origin.z + centerZ/count +
+            Face.planeSlope.x*((Face.minimum.x-origin.x) - centerX/count) +
+            Face.planeSlope.y*((Face.minimum.y-origin.y) - centerY/count);
+    return true;
+}
+
+void WavefrontObject::updateFaces()
+{
+    int count = 0;
+    for(int i=0; i<faces.size(); i++) {
+        updateBounds(faces[i]);
+        if(updatePlane(faces[i]))
+            faces[count++] = faces[i];
+    }
+    faces.resize(count);
+}
+
+bool WavefrontObject::isPointInPolygon(const WavefrontFace &Face, Coordinate2D Point)
+{
+    int i, j, nvert = Face.vertexCount;
+    const int *index = indices.constData() + Face.firstIndex;
+    bool c = false;
+
+    for(i = 0, j = nvert - 1; i < nvert; j = i++) {
+        const Coordinate3D &vi = vertices[index[i]];
+        const Coordinate3D &vj = vertices[index[j]];
+        if( ( (vi.y >= Point.y ) != (vj.y >= Point.y) ) &&
+            (Point.x <= (vj.x - vi.x) * (Point.y - vi.y) / (vj.y - vi.y) + vi.x)
+          )
+          c = !c;
+    }
+
+    return c;
+}
+
+Coordinate3D WavefrontObject::getHeight(const WavefrontFace &Face, Coordinate2D Point)
+{
+    return Coordinate3D(Point.x, Point.y, Face.getHeight(Point));
+}
+
+Wavefront::Wavefront(QString Filename, bool commandLineOutput, bool UseCache, QString CacheDirectory, int LoadThreads)
 {
-    QCoreApplication::processEvents();
-    timer = new QTimer(this);
-    connect(timer, SIGNAL(timeout()), this, SLOT(outputProgress()));
     this->commandLineOutput = commandLineOutput;
     filename = Filename;
+    useCache = UseCache;
+    cacheDirectory = CacheDirectory;
+    loadThreads = LoadThreads;
+    rasterMode = EdgeFunctionRaster;
+    heightMode = PlaneHeight;
+    setSampling(1);
+    resolveFilter = MaximumResolve;
+    channels = Grid::HeightChannel;
+    threadCount = 1;
+    tilePool = nullptr;
+    incremental = false;
+    incrementalPrecision = 0.;
+    incrementalRasterMode = rasterMode;
+    incrementalHeightMode = heightMode;
     getObjects(Filename);
+    updateExtent();
 }
 
 Wavefront::~Wavefront()
 {
-    timer->stop();
 }
 
-Grid Wavefront::getHeatmap(double Precision)
+void Wavefront::setRasterMode(RasterMode Mode)
 {
-    bool isPointInPolygon;
-    WavefrontFace face;
-    Coordinate2D faceMinimumPoint, faceMaximumPoint;
-    Pixel2D faceMinimumPixel, faceMaximumPixel;
-    Coordinate3D oldVertex, newVertex;
-    QDateTime timeEnd, timeLastUpdate;
-    timeStart = QDateTime::currentDateTime();
-    timeLastUpdate = timeStart;
+    rasterMode = Mode;
+}
 
-    Grid grid = Grid(getMinimum(), getMaximum(), Precision);
+Wavefront::RasterMode Wavefront::getRasterMode()
+{
+    return rasterMode;
+}
 
-    totalNumberOfIterations = getNumberOfIterations(grid);
-    iteration = 0;
-    timer->start(1000);
+void Wavefront::setHeightMode(HeightMode Mode)
+{
+    heightMode = Mode;
+}
 
-    for(int i=0; i<objects.size(); i++) {
-        for(int j=0; j<objects[i].faces.size(); j++) {
-            face = objects[i].faces[j];
-
-            faceMinimumPoint = face.getMinimum();
-            faceMinimumPixel = grid.getFloorPixel(faceMinimumPoint);
-
-            faceMaximumPoint = face.getMaximum();
-            faceMaximumPixel = grid.getCeilPixel(faceMaximumPoint);
-
-            for(int k=faceMinimumPixel.i; k<=faceMaximumPixel.i; k++) {
-                for(int l=faceMinimumPixel.j; l<=faceMaximumPixel.j; l++) {
-                    QCoreApplication::processEvents();
-                    iteration += 1;
-                    oldVertex = grid.getCoordinate3D(Pixel2D(k,l));
-                    isPointInPolygon = face.isPointInPolygon(Coordinate2D(oldVertex.x,oldVertex.y));
-                    if(isPointInPolygon) {
-                        newVertex = face.getHeight(Coordinate2D(oldVertex.x,oldVertex.y));
-                        if(newVertex.isValid && (newVertex.z > oldVertex.z || !oldVertex.isValid)) {
-                            grid.setValue(Pixel2D(k,l), newVertex.z);
-                        }
-                    }
-                }
-            }
+Wavefront::HeightMode Wavefront::getHeightMode()
+{
+    return heightMode;
+}
+
+// Rotated grid positions in 1/16 pixel: no two samples share a row or a
+// column of the 16x16 grid.
+static const int rotatedSamples2[2][2] = {{4, 4}, {-4, -4}};
+static const int rotatedSamples4[4][2] = {{-2, -6}, {6, -2}, {-6, 2}, {2, 6}};
+static const int rotatedSamples8[8][2] = {{1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}};
+static const int rotatedSamples16[16][2] = {{1, 1}, {-1, -3}, {-3, 2}, {4, -1}, {-5, -2}, {2, 5}, {5, 3}, {3, -5},
+                                            {-2, 6}, {0, -7}, {-4, -6}, {-6, 4}, {-8, 0}, {7, -4}, {6, 7}, {-7, -8}};
+
+bool Wavefront::isValidSampling(int Count, SamplePattern Pattern)
+{
+    if(Pattern == RotatedGridSamples)
+        return Count == 1 || Count == 2 || Count == 4 || Count == 8 || Count == 16;
+    int k = int(std::lround(std::sqrt(double(Count))));
+    return Count >= 1 && Count <= 256 && k*k == Count;
+}
+
+void Wavefront::setSampling(int Count, SamplePattern Pattern)
+{
+    if(!isValidSampling(Count, Pattern))
+        return;
+    sampleCount = Count;
+    samplePattern = Pattern;
+    sampleOffsets.clear();
+    if(Count == 1) {
+        sampleOffsets.append(Coordinate2D(0., 0.));
+        return;
+    }
+    if(Pattern == RotatedGridSamples) {
+        const int (*positions)[2] = Count == 2 ? rotatedSamples2 : Count == 4 ? rotatedSamples4 :
+                                    Count == 8 ? rotatedSamples8 : rotatedSamples16;
+        for(int i=0; i<Count; i++)
+            sampleOffsets.append(Coordinate2D(positions[i][0]/16., positions[i][1]/16.));
+        return;
+    }
+    // Every cell gets its own fixed position from a low-discrepancy
+    // sequence, the same in every pixel and every run.
+    int k = int(std::lround(std::sqrt(double(Count))));
+    for(int b=0; b<k; b++) {
+        for(int a=0; a<k; a++) {
+            int cell = b*k + a;
+            double jitterX = std::fmod(0.5 + cell*0.6180339887498949, 1.);
+            double jitterY = std::fmod(0.5 + cell*0.7548776662466927, 1.);
+            sampleOffsets.append(Coordinate2D((a + jitterX)/k - 0.5, (b + jitterY)/k - 0.5));
         }
     }
-    timer->stop();
-    return grid;
 }
 
-double Wavefront::getWidth()
+Coordinate2D Wavefront::getSampleReach()
 {
-    Coordinate2D max = getMaximum();
-    Coordinate2D min = getMinimum();
+    Coordinate2D reach = Coordinate2D(0., 0.);
+    for(int s=0; s<sampleOffsets.size(); s++)
+        reach = Coordinate2D(qMax(reach.x, std::fabs(sampleOffsets[s].x)), qMax(reach.y, std::fabs(sampleOffsets[s].y)));
+    return reach;
+}
 
-    return max.x - min.x;
+int Wavefront::getSampleCount()
+{
+    return sampleCount;
 }
 
-double Wavefront::getHeight()
+Wavefront::SamplePattern Wavefront::getSamplePattern()
 {
-    Coordinate2D max = getMaximum();
-    Coordinate2D min = getMinimum();
+    return samplePattern;
+}
 
-    return max.y - min.y;
+void Wavefront::setResolveFilter(ResolveFilter Filter)
+{
+    resolveFilter = Filter;
 }
 
+Wavefront::ResolveFilter Wavefront::getResolveFilter()
+{
+    return resolveFilter;
+}
 
-QImage Wavefront::getImage(Grid grid)
+void Wavefront::setChannels(int Channels)
 {
-    QImage image = QImage(grid.getWidth(), grid.getHeight(), QImage::Format_Grayscale8);
-    image.setColorCount(255);
+    channels = Channels | Grid::HeightChannel;
+}
 
-    for(int i=0; i<255; i++) {
-        image.setColor(i,QColor(i,i,i, 0).rgb());
-    }
+int Wavefront::getChannels()
+{
+    return channels;
+}
 
-    grid.normalize();
+int Wavefront::getRenderChannels()
+{
+    return sampleCount > 1 ? int(Grid::HeightChannel) : channels;
+}
 
-    int height = grid.getHeight();
-    int width  = grid.getWidth();
+void Wavefront::setThreadCount(int Count)
+{
+    threadCount = Count;
+}
 
-    for(int i=0; i<width; i++) {
-        for(int j=0; j<height; j++) {
-            Coordinate3D coordinate3D = grid.getCoordinate3D(Pixel2D(i,j));
-            if(coordinate3D.isValid) {
-                int value = coordinate3D.z*255.;
-                image.setPixel(i, height-1-j, qRgb(value, value, value));
-            }
-            else {
-                image.setPixel(i, height-1-j, 0);
-            }
-        }
-    }
-    return image;
+int Wavefront::getThreadCount()
+{
+    return threadCount;
 }
 
-void Wavefront::saveImage(QImage Image, QString Filename)
+Grid Wavefront::getHeatmap(double Precision)
 {
-    Image.save(Filename, "PNG", -1);
+    if(incremental)
+        return renderIncrementalHeatmap(Precision, threadCount);
+    return renderHeatmap(Precision, threadCount, false);
 }
 
-void Wavefront::outputProgress()
+Grid Wavefront::getHeatmap(double Precision, Coordinate2D Minimum, Coordinate2D Maximum)
 {
-    double progress = double(iteration)/double(totalNumberOfIterations)*100.;
-    int elapsed = (QDateTime::currentDateTime().toMSecsSinceEpoch()-timeStart.toMSecsSinceEpoch())/1000;
-    int remaining = double(elapsed)/double(progress)*(100.-double(progress));
-    if(commandLineOutput) {
-        if(elapsed == 0) {
-            std::cout << "Progress: " << progress << " %. " <<
-                         "Elapsed: " << elapsed << " s. " << std::endl;
-        }
-        else {
-                std::cout << "Progress: " << progress << " %. " <<
-                             "Elapsed: " << elapsed << " s. " <<
-                             "Remaining: " << remaining << " s." << std::endl;
-        }
-    }
-    else {
-        // TODO: implement timed signal that informs about progress
-    }
+    return renderHeatmap(Precision, Minimum, Maximum, threadCount, false);
 }
 
-QVector<WavefrontObject> Wavefront::getObjects(QString Filename)
+bool Wavefront::saveStripedHeatmap(double Precision, QString Filename, HeightmapWriter::Format Format, qint64 MaxMemory)
 {
-    if(!objects.isEmpty())
-        return objects;
+    return renderStripedHeatmap(Precision, Filename, Format, MaxMemory, threadCount, false);
+}
 
-    QFile file(Filename);
-    if(!file.exists())
-        return objects;
+double Wavefront::getPrecision(qint64 PixelCount)
+{
+    return std::sqrt((getWidth()*getHeight())/double(PixelCount));
+}
 
-    file.open(QIODevice::ReadOnly | QIODevice::Text);
-    QTextStream in(&file);
-    QString contents = in.readAll();
-    file.close();
-
-    QStringList lines = contents.split("\n");
-    QVector<Coordinate3D> vertices;
-    QVector<Coordinate3D> normals;
-    WavefrontObject object = WavefrontObject();
-
-    for(int i=0; i<lines.size(); i++) {
-        QStringList line = lines[i].split(" ");
-        QString identifier;
-        if(!line.isEmpty())
-            identifier = line[0];
-
-        if(identifier == "o") {
-            if(!object.name.isEmpty()) {
-                objects.append(object);
-                object = WavefrontObject();
-            }
-            object.name = line[1];
-        }
-        else if(!object.name.isEmpty() && identifier == "v") {
-            vertices.append(Coordinate3D(line[1].toDouble(), line[2].toDouble(), line[3].toDouble()));
-        }
-        else if(!object.name.isEmpty() && identifier == "vn") {
-            normals.append(Coordinate3D(line[1].toDouble(), line[2].toDouble(), line[3].toDouble()));
-        }
-        else if(!object.name.isEmpty() && identifier == "f") {
-            WavefrontFace face = WavefrontFace();
-            int numberOfVertices = line.size() - 1;
-            for(int k=1; k<numberOfVertices+1; k++) {
-                QStringList item = line[k].split("//");
-                if(k==1) {
-                    int u = item[1].toInt()-1;
-                    face.normal = normals[u];
-                }
-                face.vertices.append(vertices[item[0].toInt()-1]);
-            }
-            object.faces.append(face);
-        }
-        if(!object.name.isEmpty() && lines.size()-1==i) {
-            objects.append(object);
-        }
+bool Wavefront::renderBatch(QVector<HeatmapJob> &Jobs)
+{
+    if(Jobs.isEmpty())
+        return true;
+
+    // Jobs run side by side, the threads left over go to their tiles.
+    int threads = threadCount > 0 ? threadCount : QThread::idealThreadCount();
+    int parallelJobs = qMax(1, qMin(threads, Jobs.size()));
+    int tileThreads = qMax(1, threads/parallelJobs);
+
+    // The jobs only add to the batch's progress, so its total is counted
+    // up front.
+    qint64 iterations = 0;
+    for(int i=0; i<Jobs.size(); i++)
+        iterations += getJobIterations(Jobs[i]);
+    progress.start(iterations);
+    ProgressReporter reporter(&progress, getProgressCallback());
+    if(getProgressCallback())
+        reporter.start();
+
+    QVector<HeatmapJobTask*> tasks;
+    QThreadPool pool;
+    pool.setMaxThreadCount(parallelJobs);
+    for(int i=0; i<Jobs.size(); i++) {
+        tasks.append(new HeatmapJobTask(this, &Jobs[i], tileThreads));
+        pool.start(tasks.last());
     }
-    return objects;
+    pool.waitForDone();
+    qDeleteAll(tasks);
+
+    bool isWritten = true;
+    for(int i=0; i<Jobs.size(); i++)
+        isWritten = isWritten && Jobs[i].isWritten;
+    return isWritten;
 }
 
-Coordinate2D Wavefront::getMinimum()
+double Wavefront::getJobPrecision(HeatmapJob &Job)
 {
-    double maxDouble = 9999999.;
-    Coordinate2D minimum = Coordinate2D(maxDouble,maxDouble);
-    for(int i=0; i<objects.size(); i++) {
-        if(!objects[i].isActive)
-            continue;
-        for(int j=0; j<objects[i].faces.size(); j++) {
-            for(int k=0; k<objects[i].faces[j].vertices.size(); k++) {
-                if(minimum.x > objects[i].faces[j].vertices[k].x)
-                    minimum.x = objects[i].faces[j].vertices[k].x;
-                if(minimum.y > objects[i].faces[j].vertices[k].y)
-                    minimum.y = objects[i].faces[j].vertices[k].y;
-            }
-        }
-    }
-    return minimum;
+    return Job.precision > 0. ? Job.precision : getPrecision(Job.pixelCount);
 }
 
-Coordinate2D Wavefront::getMaximum()
+// The same count the job's render path passes to startProgress().
+qint64 Wavefront::getJobIterations(HeatmapJob &Job)
 {
-    double minDouble = -9999999.;
-    Coordinate2D maximum = Coordinate2D(minDouble,minDouble);
-    for(int i=0; i<objects.size(); i++) {
-        if(!objects[i].isActive)
-            continue;
-        for(int j=0; j<objects[i].faces.size(); j++) {
-            for(int k=0; k<objects[i].faces[j].vertices.size(); k++) {
-                if(maximum.x < objects[i].faces[j].vertices[k].x)
-                    maximum.x = objects[i].faces[j].vertices[k].x;
-                if(maximum.y < objects[i].faces[j].vertices[k].y)
-                    maximum.y = objects[i].faces[j].vertices[k].y;
-            }
-        }
+    double precision = getJobPrecision(Job);
+    QScopedPointer<HeightmapWriter> writer(HeightmapWriter::create(Job.format));
+    if(!(precision > 0.) || !writer)
+        return 0;
+
+    Grid layout = Grid(getMinimum(), getMaximum(), precision, false);
+    if(Job.hasCrop) {
+        Pixel2D windowMinimum, windowMaximum;
+        getCropWindow(layout, Job.cropMinimum, Job.cropMaximum, windowMinimum, windowMaximum);
+        return getNumberOfIterations(windowMinimum, windowMaximum, getRasterFaces(layout, windowMinimum, windowMaximum));
     }
-    return maximum;
+    qint64 iterations = getNumberOfIterations(layout.getWindowMinimum(), layout.getWindowMaximum(), getRasterFaces(layout));
+    if(Job.maxMemory > 0 && writer->isNormalized())
+        iterations *= 2;
+    return iterations;
 }
 
-int Wavefront::getNumberOfIterations(Grid grid)
+bool Wavefront::renderJob(HeatmapJob &Job, int Threads)
 {
-    WavefrontFace face;
-    Coordinate2D faceMinimumPoint, faceMaximumPoint;
-    Pixel2D faceMinimumPixel, faceMaximumPixel;
-    int number = 0;
-    for(int i=0; i<objects.size(); i++) {
-        for(int j=0; j<objects[i].faces.size(); j++) {
-            face = objects[i].faces[j];
+    double precision = getJobPrecision(Job);
+    // Crops are only rendered in memory, so they can not keep to a limit.
+    if(!(precision > 0.) || Job.outputFilename.isEmpty() || (Job.hasCrop && Job.maxMemory > 0))
+        return false;
+    if(Job.maxMemory > 0)
+        return renderStripedHeatmap(precision, Job.outputFilename, Job.format, Job.maxMemory, Threads, true);
+
+    Grid heatmap = Job.hasCrop ? renderHeatmap(precision, Job.cropMinimum, Job.cropMaximum, Threads, true)
+                               : renderHeatmap(precision, Threads, true);
+    return saveChannels(heatmap, Job.outputFilename, Job.format);
+}
 
-            faceMinimumPoint = face.getMinimum();
-            faceMinimumPixel = grid.getFloorPixel(faceMinimumPoint);
+void Wavefront::startProgress(qint64 Total, ProgressReporter &Reporter, bool IsBatchJob)
+{
+    if(IsBatchJob)
+        return;
+    progress.start(Total);
+    if(getProgressCallback())
+        Reporter.start();
+}
 
-            faceMaximumPoint = face.getMaximum();
-            faceMaximumPixel = grid.getCeilPixel(faceMaximumPoint);
+Grid Wavefront::renderHeatmap(double Precision, int Threads, bool IsBatchJob)
+{
+    Grid grid = Grid(getMinimum(), getMaximum(), Precision);
+    grid.enableChannels(getRenderChannels());
+    QVector<RasterFace> faces = getRasterFaces(grid);
 
-            number += (faceMaximumPixel.i - faceMinimumPixel.i + 1)*(faceMaximumPixel.j - faceMinimumPixel.j + 1);
-        }
-    }
-    return number;
+    ProgressReporter reporter(&progress, getProgressCallback());
+    startProgress(getNumberOfIterations(grid.getWindowMinimum(), grid.getWindowMaximum(), faces), reporter, IsBatchJob);
+
+    rasterizeFaces(grid, faces, Threads);
+    return grid;
 }
 
-Grid::Grid(Coordinate2D Minimum, Coordinate2D Maximum, double Precision)
+Grid Wavefront::renderHeatmap(double Precision, Coordinate2D Minimum, Coordinate2D Maximum, int Threads, bool IsBatchJob)
 {
-    double lengthX = Maximum.x - Minimum.x;
-    double lengthY = Maximum.y - Minimum.y;
-    height = int(lengthY/Precision);
-    width = int(lengthX/Precision);
-    minimum = Minimum;
-    maximum = Maximum;
+    Grid layout = Grid(getMinimum(), getMaximum(), Precision, false);
+    Pixel2D windowMinimum, windowMaximum;
+    getCropWindow(layout, Minimum, Maximum, windowMinimum, windowMaximum);
+    Grid grid = Grid(layout, windowMinimum, windowMaximum);
+    grid.enableChannels(getRenderChannels());
+    QVector<RasterFace> faces = getRasterFaces(layout, windowMinimum, windowMaximum);
 
+    ProgressReporter reporter(&progress, getProgressCallback());
+    startProgress(getNumberOfIterations(windowMinimum, windowMaximum, faces), reporter, IsBatchJob);
 
-    double slopeX, slopeY;
-    if(width == 1)
-        slopeX = 0.;
-    else
-        slopeX = lengthX/double(width-1);
+    rasterizeFaces(grid, faces, Threads);
+    return grid;
+}
 
-    if(height == 1)
-        slopeY = 0.;
-    else
-        slopeY = lengthY/double(height-1);
+bool Wavefront::renderStripedHeatmap(double Precision, QString Filename, HeightmapWriter::Format Format, qint64 MaxMemory,
+                                     int Threads, bool IsBatchJob)
+{
+    // The heights and every further channel go to a file of their own.
+    int renderChannels = getRenderChannels();
+    QVector<Grid::Channel> types;
+    QVector<HeightmapWriter*> writers;
+    for(int k=0; k<6; k++) {
+        if(!(renderChannels & (1 << k)))
+            continue;
+        types.append(Grid::Channel(1 << k));
+        writers.append(HeightmapWriter::create(Format));
+    }
+    if(!writers[0]) {
+        qDeleteAll(writers);
+        return false;
+    }
 
-    pixels.resize(width);
-    for(int i=0; i<width; i++) {
-        pixels[i].resize(height);
-        for(int j=0; j<height; j++) {
-            pixels[i][j] = Coordinate3D(Minimum.x+double(i)*slopeX, Minimum.y+double(j)*slopeY);
+    Grid layout = Grid(getMinimum(), getMaximum(), Precision, false);
+    int width = layout.getWidth();
+    int height = layout.getHeight();
+    int bandHeight = getBandHeight(layout, MaxMemory);
+    if(bandHeight == 0) {
+        if(commandLineOutput)
+            std::cout << "A single row of " << Filename.toStdString() << " needs more than " << MaxMemory <<
+                         " bytes of memory." << std::endl;
+        qDeleteAll(writers);
+        return false;
+    }
+    int bandCount = (height + bandHeight - 1)/bandHeight;
+
+    // Band b holds the rows [top-bandHeight+1, top] with top = height-1-b*bandHeight.
+    // Every face is listed in all bands its bounding box touches, in the
+    // serial face order. The lists of all bands share one buffer, sized by
+    // counting first; band b ends up as [ends[b-1], ends[b]).
+    QVector<RasterFace> faces = getRasterFaces(layout);
+    QVector<int> ends;
+    ends.fill(0, bandCount+1);
+    for(int i=0; i<faces.size(); i++) {
+        int firstBand = qMax(0, (height-1-faces[i].maximum.j)/bandHeight);
+        int lastBand = qMin(bandCount-1, (height-1-faces[i].minimum.j)/bandHeight);
+        for(int b=firstBand; b<=lastBand; b++)
+            ends[b+1]++;
+    }
+    for(int b=0; b<bandCount; b++)
+        ends[b+1] += ends[b];
+    QVector<RasterFace> bands(ends.last());
+    for(int i=0; i<faces.size(); i++) {
+        int firstBand = qMax(0, (height-1-faces[i].maximum.j)/bandHeight);
+        int lastBand = qMin(bandCount-1, (height-1-faces[i].minimum.j)/bandHeight);
+        for(int b=firstBand; b<=lastBand; b++)
+            bands[ends[b]++] = faces[i];
+    }
+    int passes = writers[0]->isNormalized() ? 2 : 1;
+    ProgressReporter reporter(&progress, getProgressCallback());
+    startProgress(getNumberOfIterations(layout.getWindowMinimum(), layout.getWindowMaximum(), faces)*passes,
+                  reporter, IsBatchJob);
+    faces.clear();
+    faces.squeeze();
+
+    // With two passes the first one only collects the range of every
+    // channel; the last pass writes.
+    QVector<double> minimums, maximums;
+    QVector<bool> isFound;
+    minimums.fill(0., types.size());
+    maximums.fill(0., types.size());
+    isFound.fill(false, types.size());
+    bool isWritten = true;
+    for(int pass=passes; pass>0 && isWritten; pass--) {
+        for(int t=0; t<types.size() && pass == 1 && isWritten; t++)
+            isWritten = writers[t]->open(getChannelFilename(Filename, types[t]), layout, minimums[t], maximums[t]);
+
+        // One band buffer is moved down the image, and the other channels
+        // are copied into a second one for writing.
+        Grid band = Grid(layout, Pixel2D(0, qMax(0, height-bandHeight)), Pixel2D(width-1, height-1));
+        band.enableChannels(renderChannels);
+        QScopedPointer<Grid> layer;
+        if(types.size() > 1)
+            layer.reset(new Grid(layout, band.getWindowMinimum(), band.getWindowMaximum()));
+        for(int b=0; b<bandCount && isWritten; b++) {
+            int top = height-1-b*bandHeight;
+            int bottom = qMax(0, top-bandHeight+1);
+            if(b > 0)
+                band.moveWindow(Pixel2D(0, bottom), Pixel2D(width-1, top));
+            int first = b > 0 ? ends[b-1] : 0;
+            rasterizeFaces(band, bands.constData() + first, ends[b] - first, Threads);
+
+            for(int t=0; t<types.size() && isWritten; t++) {
+                Grid *source = &band;
+                if(types[t] != Grid::HeightChannel) {
+                    band.getChannel(types[t], *layer);
+                    source = layer.data();
+                }
+                if(pass == 1) {
+                    for(int j=top; j>=bottom && isWritten; j--)
+                        isWritten = writers[t]->writeRow(*source, j);
+                    continue;
+                }
+                double bandMinimum, bandMaximum;
+                if(!source->getRange(bandMinimum, bandMaximum))
+                    continue;
+                if(!isFound[t] || minimums[t] > bandMinimum)
+                    minimums[t] = bandMinimum;
+                if(!isFound[t] || maximums[t] < bandMaximum)
+                    maximums[t] = bandMaximum;
+                isFound[t] = true;
+            }
         }
     }
+    for(int t=0; t<writers.size() && isWritten; t++)
+        isWritten = writers[t]->close();
+    qDeleteAll(writers);
+    return isWritten;
 }
 
-void Grid::setValue(Pixel2D Pixel, double Value)
+bool Wavefront::savePyramid(QString Directory, int MinimumZoom, int MaximumZoom, HeightmapWriter::Format Format)
 {
-    pixels[Pixel.i][Pixel.j].z = Value;
-    pixels[Pixel.i][Pixel.j].isValid = true;
+    return savePyramid(Directory, MinimumZoom, MaximumZoom, getMinimum(), getMaximum(), Format);
 }
 
-Coordinate3D Grid::getCoordinate3D(Pixel2D Pixel)
+bool Wavefront::savePyramid(QString Directory, int MinimumZoom, int MaximumZoom, Coordinate2D Minimum, Coordinate2D Maximum,
+                            HeightmapWriter::Format Format)
 {
-    return pixels[Pixel.i][Pixel.j];
+    const int tileSize = 256;
+    SpatialIndex *index = getSpatialIndex();
+    QString suffix = HeightmapWriter::getSuffix(Format);
+    if(suffix.isEmpty() || MinimumZoom < 0 || MaximumZoom < MinimumZoom || MaximumZoom > 24)
+        return false;
+
+    // The root tile is the square spanned from the top-left corner.
+    double side = qMax(Maximum.x - Minimum.x, Maximum.y - Minimum.y);
+    double left = Minimum.x;
+    double top = Maximum.y;
+
+    // One height range for all tiles, so that they fit together. Only tiles
+    // within the extent of the faces found can hold any of them.
+    QVector<SpatialIndex::Face> found = index->queryRectangle(Minimum, Maximum);
+    if(found.isEmpty())
+        return true;
+    double heightMinimum, heightMaximum;
+    heightMinimum = heightMaximum = found[0].object->getVertex(*found[0].face, 0).z;
+    Coordinate2D extentMinimum = found[0].face->getMinimum();
+    Coordinate2D extentMaximum = found[0].face->getMaximum();
+    for(int i=0; i<found.size(); i++) {
+        for(int k=0; k<found[i].face->vertexCount; k++) {
+            double z = found[i].object->getVertex(*found[i].face, k).z;
+            heightMinimum = qMin(heightMinimum, z);
+            heightMaximum = qMax(heightMaximum, z);
+        }
+        Coordinate2D faceMinimum = found[i].face->getMinimum();
+        Coordinate2D faceMaximum = found[i].face->getMaximum();
+        extentMinimum = Coordinate2D(qMin(extentMinimum.x, faceMinimum.x), qMin(extentMinimum.y, faceMinimum.y));
+        extentMaximum = Coordinate2D(qMax(extentMaximum.x, faceMaximum.x), qMax(extentMaximum.y, faceMaximum.y));
+    }
+
+    // Progress is estimated from the faces' boxes on every level, so that no
+    // tile has to be looked at twice.
+    qint64 iterations = 0;
+    for(int zoom=MinimumZoom; zoom<=MaximumZoom; zoom++) {
+        double pitch = side/double(qint64(tileSize) << zoom);
+        for(int i=0; i<found.size(); i++) {
+            Coordinate2D faceMinimum = found[i].face->getMinimum();
+            Coordinate2D faceMaximum = found[i].face->getMaximum();
+            double width = qMin(faceMaximum.x, left + side) - qMax(faceMinimum.x, left);
+            double height = qMin(faceMaximum.y, top) - qMax(faceMinimum.y, top - side);
+            if(width >= 0. && height >= 0.)
+                iterations += (qint64(width/pitch) + 1)*(qint64(height/pitch) + 1);
+        }
+    }
+    found.clear();
+    found.squeeze();
+
+    progress.start(iterations);
+    ProgressReporter reporter(&progress, getProgressCallback());
+    if(getProgressCallback())
+        reporter.start();
+
+    // Tiles go to the pool in batches and are freed once a batch is done,
+    // so only a few of them hold their faces at any time.
+    QThreadPool pool;
+    if(threadCount > 0)
+        pool.setMaxThreadCount(threadCount);
+    const int batchSize = 16*pool.maxThreadCount();
+    Coordinate2D reach = getSampleReach();
+    QVector<PyramidTile*> tiles;
+    bool isWritten = true;
+    for(int zoom=MinimumZoom; zoom<=MaximumZoom && isWritten; zoom++) {
+        int count = 1 << zoom;
+        double tileSide = side/double(count);
+        double pitch = tileSide/double(tileSize);
+        // One tile more on every side, the queries below settle it.
+        int firstX = int(qBound(0., std::floor((extentMinimum.x - left)/tileSide) - 1., double(count-1)));
+        int lastX = int(qBound(0., std::floor((extentMaximum.x - left)/tileSide) + 1., double(count-1)));
+        int firstY = int(qBound(0., std::floor((top - extentMaximum.y)/tileSide) - 1., double(count-1)));
+        int lastY = int(qBound(0., std::floor((top - extentMinimum.y)/tileSide) + 1., double(count-1)));
+        for(int x=firstX; x<=lastX && isWritten; x++) {
+            for(int y=firstY; y<=lastY && isWritten; y++) {
+                // Pixel centers sit half a pixel inside the tile's edges.
+                Coordinate2D tileMinimum = Coordinate2D(left + double(x)*tileSide + 0.5*pitch,
+                                                        top - double(y+1)*tileSide + 0.5*pitch);
+                Coordinate2D tileMaximum = Coordinate2D(tileMinimum.x + double(tileSize-1)*pitch,
+                                                        tileMinimum.y + double(tileSize-1)*pitch);
+                found = index->queryRectangle(Coordinate2D(tileMinimum.x - reach.x*pitch, tileMinimum.y - reach.y*pitch),
+                                              Coordinate2D(tileMaximum.x + reach.x*pitch, tileMaximum.y + reach.y*pitch));
+                if(found.isEmpty())
+                    continue;
+
+                PyramidTile *tile = new PyramidTile(this, QString("%1/%2/%3/%4.%5").arg(Directory).arg(zoom).arg(x).arg(y).arg(suffix),
+                                                    tileMinimum, tileMaximum, tileSize, Format, heightMinimum, heightMaximum);
+                for(int i=0; i<found.size(); i++)
+                    tile->addFace(found[i].object, found[i].face);
+                tiles.append(tile);
+                pool.start(tile);
+                if(tiles.size() >= batchSize)
+                    isWritten = finishPyramidTiles(pool, tiles);
+            }
+        }
+    }
+    return finishPyramidTiles(pool, tiles) && isWritten;
 }
 
-Coordinate2D Grid::getCoordinate2D(Pixel2D Pixel)
+bool Wavefront::finishPyramidTiles(QThreadPool &Pool, QVector<PyramidTile*> &Tiles)
 {
-    Coordinate3D c = pixels[Pixel.i][Pixel.j];
-    return Coordinate2D(c.x,c.y);
+    Pool.waitForDone();
+    bool isWritten = true;
+    for(int i=0; i<Tiles.size(); i++)
+        isWritten = isWritten && Tiles[i]->getResult() != PyramidTile::Failed;
+    qDeleteAll(Tiles);
+    Tiles.clear();
+    return isWritten;
 }
 
-Pixel2D Grid::getFloorPixel(Coordinate2D Point)
+QVector<RasterFace> Wavefront::getRasterFaces(Grid &grid)
 {
-    Pixel2D minimumPixel = Pixel2D(0, 0);
-    for(int j=0; j<height; j++) {
-        if(pixels[0][j].y > Point.y)
-            break;
-        minimumPixel.j = j;
+    ScopedTimer timer(Statistics::CountTimer);
+    int count = 0;
+    for(int i=0; i<objects.size(); i++) {
+        if(objects[i].isActive)
+            count += objects[i].faces.size();
     }
-
-    for(int i=0; i<width; i++) {
-        if(pixels[i][0].x > Point.x)
-            break;
-        minimumPixel.i = i;
+    QVector<RasterFace> faces;
+    faces.reserve(count);
+    for(int i=0; i<objects.size(); i++) {
+        if(!objects[i].isActive)
+            continue;
+        for(int j=0; j<objects[i].faces.size(); j++) {
+            RasterFace face;
+            face.object = &objects[i];
+            face.face = &objects[i].faces[j];
+            face.minimum = grid.getFloorPixel(face.face->getMinimum());
+            face.maximum = grid.getCeilPixel(face.face->getMaximum());
+            faces.append(face);
+        }
     }
-
-    return minimumPixel;
+    return faces;
 }
 
-Pixel2D Grid::getCeilPixel(Coordinate2D Point)
+// Pixels of Layout within [Minimum, Maximum], at least one.
+void Wavefront::getCropWindow(Grid &Layout, Coordinate2D Minimum, Coordinate2D Maximum,
+                              Pixel2D &WindowMinimum, Pixel2D &WindowMaximum)
 {
-    Pixel2D maximumPixel = Pixel2D(width-1, height-1);
-    for(int j=0; j<height; j++) {
-        if(pixels[0][j].y < Point.y)
-            break;
-        maximumPixel.j = j;
-    }
+    WindowMinimum = Layout.getCeilPixel(Minimum);
+    WindowMaximum = Layout.getFloorPixel(Maximum);
+    WindowMaximum.i = qMax(WindowMaximum.i, WindowMinimum.i);
+    WindowMaximum.j = qMax(WindowMaximum.j, WindowMinimum.j);
+}
 
-    for(int i=0; i<width; i++) {
-        if(pixels[i][0].x < Point.x)
-            break;
-        maximumPixel.i = i;
+// Faces overlapping the window, found through the spatial index.
+QVector<RasterFace> Wavefront::getRasterFaces(Grid &grid, Pixel2D WindowMinimum, Pixel2D WindowMaximum)
+{
+    SpatialIndex *index = getSpatialIndex();
+    ScopedTimer timer(Statistics::CountTimer);
+    // Samples of the pixels on the border reach beyond the window.
+    Coordinate2D slope = grid.getSlope();
+    Coordinate2D reach = getSampleReach();
+    Coordinate2D margin = Coordinate2D(reach.x*slope.x, reach.y*slope.y);
+    Coordinate2D minimum = grid.getCoordinate2D(WindowMinimum);
+    Coordinate2D maximum = grid.getCoordinate2D(WindowMaximum);
+    QVector<SpatialIndex::Face> found = index->queryRectangle(Coordinate2D(minimum.x - margin.x, minimum.y - margin.y),
+                                                              Coordinate2D(maximum.x + margin.x, maximum.y + margin.y));
+    QVector<RasterFace> faces;
+    faces.reserve(found.size());
+    for(int i=0; i<found.size(); i++) {
+        RasterFace face;
+        face.object = found[i].object;
+        face.face = found[i].face;
+        face.minimum = grid.getFloorPixel(face.face->getMinimum());
+        face.maximum = grid.getCeilPixel(face.face->getMaximum());
+        faces.append(face);
     }
-
-    return maximumPixel;
+    return faces;
 }
 
-int Grid::getHeight()
+void Wavefront::rasterizeFaces(Grid &grid, const QVector<RasterFace> &Faces, int Threads)
 {
-    return height;
+    rasterizeFaces(grid, Faces.constData(), Faces.size(), Threads);
 }
 
-int Grid::getWidth()
+void Wavefront::rasterizeFaces(Grid &grid, const RasterFace *Faces, int Count, int Threads)
 {
-    return width;
+    ScopedTimer timer(Statistics::RasterTimer);
+    // Samples are resolved tile by tile, also on a single thread.
+    if(Threads != 1 || sampleCount > 1) {
+        renderTiles(grid, Faces, Count, Threads);
+        return;
+    }
+    AllocationScope allocations;
+    for(int i=0; i<Count; i++)
+        rasterizeFace(*Faces[i].object, *Faces[i].face, grid, Faces[i].minimum, Faces[i].maximum);
 }
 
-void Grid::normalize()
+void Wavefront::renderTiles(Grid &grid, const RasterFace *Faces, int Count, int Threads)
 {
-    double globalMax = -99999.;
-    double globalMin = 99999.;
-    for(int i=0; i<width; i++) {
-        for(int j=0; j<height; j++) {
-            if(!pixels[i][j].isValid)
-                continue;
-            Coordinate3D p = pixels[i][j];
-            if(globalMax < p.z)
-                globalMax = p.z;
-            if(globalMin > p.z)
-                globalMin = p.z;
+    const int tileSize = 128;
+    Pixel2D windowMinimum = grid.getWindowMinimum();
+    Pixel2D windowMaximum = grid.getWindowMaximum();
+    int tilesX = (windowMaximum.i - windowMinimum.i + tileSize)/tileSize;
+    int tilesY = (windowMaximum.j - windowMinimum.j + tileSize)/tileSize;
+
+    // Binning keeps the serial face order within every tile, so each pixel
+    // sees the same sequence of candidates as in the serial path. The faces
+    // of all tiles go into one list, sized by counting them first; ends[t]
+    // first counts the faces of tile t-1 and ends up as the end of tile t.
+    // Samples lie up to half a pixel off the centre, so with supersampling
+    // faces also go to the tiles next to their box.
+    int margin = sampleCount > 1 ? 1 : 0;
+    QVector<int> ends;
+    ends.fill(0, tilesX*tilesY+1);
+    for(int pass=0; pass<2; pass++) {
+        QVector<RasterFace> binned;
+        if(pass == 1) {
+            for(int t=0; t<tilesX*tilesY; t++)
+                ends[t+1] += ends[t];
+            binned.resize(ends.last());
+        }
+        for(int i=0; i<Count; i++) {
+            const RasterFace &face = Faces[i];
+            int firstX = qMax(0, (face.minimum.i - margin - windowMinimum.i)/tileSize);
+            int lastX = qMin(tilesX-1, (face.maximum.i + margin - windowMinimum.i)/tileSize);
+            int firstY = qMax(0, (face.minimum.j - margin - windowMinimum.j)/tileSize);
+            int lastY = qMin(tilesY-1, (face.maximum.j + margin - windowMinimum.j)/tileSize);
+            for(int ty=firstY; ty<=lastY; ty++) {
+                for(int tx=firstX; tx<=lastX; tx++) {
+                    if(pass == 0)
+                        ends[ty*tilesX+tx+1]++;
+                    else
+                        binned[ends[ty*tilesX+tx]++] = face;
+                }
+            }
+        }
+        if(pass == 0)
+            continue;
+
+        QVector<HeatmapTile> tiles;
+        tiles.reserve(tilesX*tilesY);
+        for(int ty=0; ty<tilesY; ty++) {
+            for(int tx=0; tx<tilesX; tx++) {
+                HeatmapTile tile;
+                tile.minimum = Pixel2D(windowMinimum.i + tx*tileSize, windowMinimum.j + ty*tileSize);
+                tile.maximum = Pixel2D(qMin(tile.minimum.i + tileSize - 1, windowMaximum.i),
+                                       qMin(tile.minimum.j + tileSize - 1, windowMaximum.j));
+                int t = ty*tilesX+tx;
+                tile.firstFace = t > 0 ? ends[t-1] : 0;
+                tile.faceCount = ends[t] - tile.firstFace;
+                if(tile.faceCount > 0)
+                    tiles.append(tile);
+            }
         }
+        renderTileList(grid, tiles, binned, Threads);
     }
+}
 
-    double delta = globalMax - globalMin;
+void Wavefront::rasterizeSamples(Grid &grid, const HeatmapTile &Tile, const RasterFace *Faces, Grid &Sample, int *Counts)
+{
+    int width = Tile.maximum.i - Tile.minimum.i + 1;
+    int offset = Tile.minimum.i - grid.getWindowMinimum().i;
+    for(int s=0; s<sampleCount; s++) {
+        Sample.moveWindow(Tile.minimum, Tile.maximum);
+        Sample.setOffset(grid, sampleOffsets[s]);
+        const RasterFace *face = Faces + Tile.firstFace;
+        for(int i=0; i<Tile.faceCount; i++, face++) {
+            rasterizeFace(*face->object, *face->face, Sample, Sample.getFloorPixel(face->face->getMinimum()),
+                          Sample.getCeilPixel(face->face->getMaximum()));
+        }
 
-    for(int i=0; i<width; i++) {
-        for(int j=0; j<height; j++) {
-            if(pixels[i][j].isValid)
-                pixels[i][j].z = (pixels[i][j].z - globalMin)/delta;
+        // Folds the sample into the tile's pixels, which are empty before
+        // the first one.
+        for(int j=Tile.minimum.j; j<=Tile.maximum.j; j++) {
+            const double *source = Sample.getRow(j);
+            double *target = grid.getWritableRow(j) + offset;
+            int *count = Counts + (j - Tile.minimum.j)*width;
+            for(int i=0; i<width; i++) {
+                if(!(source[i] > emptyHeight))
+                    continue;
+                if(resolveFilter == MaximumResolve) {
+                    if(source[i] > target[i])
+                        target[i] = source[i];
+                }
+                else if(resolveFilter == MinimumResolve) {
+                    if(target[i] == emptyHeight || source[i] < target[i])
+                        target[i] = source[i];
+                }
+                else if(target[i] == emptyHeight) {
+                    target[i] = source[i];
+                    count[i] = 1;
+                }
+                else {
+                    target[i] += source[i];
+                    count[i]++;
+                }
+            }
+        }
+    }
+    if(resolveFilter != MeanResolve)
+        return;
+    for(int j=Tile.minimum.j; j<=Tile.maximum.j; j++) {
+        double *target = grid.getWritableRow(j) + offset;
+        int *count = Counts + (j - Tile.minimum.j)*width;
+        for(int i=0; i<width; i++) {
+            if(target[i] > emptyHeight)
+                target[i] /= double(count[i]);
+            count[i] = 0;
         }
     }
 }
 
+void Wavefront::renderTileList(Grid &grid, const QVector<HeatmapTile> &Tiles, const QVector<RasterFace> &Faces, int Threads)
+{
+    QAtomicInt nextTile(0);
+    int threads = qMin(Threads > 0 ? Threads : QThread::idealThreadCount(), Tiles.size());
+    if(threads <= 1) {
+        HeatmapTileWorker(this, &grid, &Tiles, Faces.constData(), &nextTile).run();
+        return;
+    }
+
+    if(tilePool) {
+        // Other renders share the pool, so only this render's workers are
+        // waited for. The pool deletes them.
+        QSemaphore finished;
+        for(int i=0; i<threads; i++) {
+            HeatmapTileWorker *worker = new HeatmapTileWorker(this, &grid, &Tiles, Faces.constData(), &nextTile, &finished);
+            worker->setAutoDelete(true);
+            tilePool->start(worker);
+        }
+        finished.acquire(threads);
+        return;
+    }
+    QVector<HeatmapTileWorker*> workers;
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    for(int i=0; i<threads; i++) {
+        workers.append(new HeatmapTileWorker(this, &grid, &Tiles, Faces.constData(), &nextTile));
+        pool.start(workers.last());
+    }
+    pool.waitForDone();
+    qDeleteAll(workers);
+}
+
+int Wavefront::getBandHeight(Grid &grid, qint64 MaxMemory)
+{
+    // Every row of a band costs its heights and channels; tiles are
+    // rendered in place.
+    qint64 width = grid.getWidth();
+    qint64 rowSize = width*qint64(Grid::getPixelSize(getRenderChannels()));
+    qint64 rows = MaxMemory/qMax(rowSize, qint64(1));
+    if(rows < 1)
+        return 0;
+    // Keep the index of a band within int.
+    rows = qMin(rows, qint64(std::numeric_limits<int>::max())/qMax(width, qint64(1)));
+    return int(qBound(qint64(1), rows, qint64(qMax(grid.getHeight(), 1))));
+}
+
+void Wavefront::rasterizeFace(WavefrontObject &Object, WavefrontFace &Face, Grid &grid, Pixel2D Minimum, Pixel2D Maximum)
+{
+    rasterizeFace(Object, Face, grid, Minimum, Maximum, grid.getWindowMinimum(), grid.getWindowMaximum());
+}
+
+void Wavefront::rasterizeFace(WavefrontObject &Object, WavefrontFace &Face, Grid &grid, Pixel2D Minimum, Pixel2D Maximum,
+                              Pixel2D ClipMinimum, Pixel2D ClipMaximum)
+{
+    qint64 covered = 0;
+    qint64 writes = 0;
+    int owner = grid.hasOwners() ? int(&Object - objects.constData()) : -1;
+    if(rasterMode == CrossingTestRaster) {
+        rasterizeFaceByCrossingTest(Object, Face, owner, grid, Minimum, Maximum, ClipMinimum, ClipMaximum, covered, writes);
+    }
+    else {
+        const int *index = Object.indices.constData() + Face.firstIndex;
+        const Coordinate3D &a = Object.vertices[index[0]];
+        const Coordinate3D &b = Object.vertices[index[1]];
+        const Coordinate3D &c = Object.vertices[index[2]];
+        rasterizeTriangle(Coordinate2D(a.x, a.y), Coordinate2D(b.x, b.y), Coordinate2D(c.x, c.y), Face, owner,
+                          grid, Minimum, Maximum, ClipMinimum, ClipMaximum, covered, writes);
+    }
+
+    // Progress counts bounding box pixels, once per face and tile.
+    qint64 columns = qMin(Maximum.i, ClipMaximum.i) - qMax(Minimum.i, ClipMinimum.i) + 1;
+    qint64 rows = qMin(Maximum.j, ClipMaximum.j) - qMax(Minimum.j, ClipMinimum.j) + 1;
+    qint64 pixels = columns > 0 && rows > 0 ? columns*rows : 0;
+    if(pixels > 0)
+        progress.add(pixels);
+
+    if(Statistics::isEnabled()) {
+        Statistics::add(Statistics::FacesCounter, 1);
+        Statistics::add(Statistics::BoundingBoxPixelsCounter, pixels);
+        Statistics::add(Statistics::CoveredPixelsCounter, covered);
+        Statistics::add(Statistics::WritesCounter, writes);
+    }
+}
+
+void Wavefront::rasterizeTriangle(Coordinate2D A, Coordinate2D B, Coordinate2D C, const WavefrontFace &Face, int Owner,
+                                  Grid &grid, Pixel2D Minimum, Pixel2D Maximum, Pixel2D ClipMinimum, Pixel2D ClipMaximum,
+                                  qint64 &Covered, qint64 &Writes)
+{
+    Coordinate2D a = A;
+    Coordinate2D b = B;
+    Coordinate2D c = C;
+    double area = (b.x-a.x)*(c.y-a.y) - (b.y-a.y)*(c.x-a.x);
+    if(area == 0.)
+        return;
+    if(area < 0.)
+        std::swap(b, c);
+
+    TriangleEdge edges[3] = { TriangleEdge(b, c), TriangleEdge(c, a), TriangleEdge(a, b) };
+
+    Coordinate2D gridMinimum = grid.getMinimum();
+    Coordinate2D slope = grid.getSlope();
+    // The height is linear along rows and columns.
+    Coordinate2D planeSlope = Face.getPlaneSlope();
+    double dz = planeSlope.x*slope.x;
+    double rowStep = planeSlope.y*slope.y;
+    // Heights of the first column of the bounding box, for RowSteppedHeight.
+    // Always counted from the box's first row, never from the window's.
+    double cornerHeight = Face.getHeight(grid.getCoordinate2D(Minimum));
+
+    // Spans are found over the face's whole bounding box [Minimum, Maximum]
+    // and only then clipped, so the interpolated heights do not depend on
+    // how the grid is split into tiles.
+    Pixel2D windowMinimum = grid.getWindowMinimum();
+    int firstRow = qMax(Minimum.j, ClipMinimum.j);
+    int lastRow = qMin(Maximum.j, ClipMaximum.j);
+    SpanKernel::Function fillSpan = SpanKernel::get();
+    SpanKernel::OwnerFunction fillOwnedSpan = grid.hasOwners() ? SpanKernel::getWithOwners() : nullptr;
+    bool hasLayers = grid.hasLayers();
+    float faceSlope = hasLayers ? float(Face.getSlopeAngle()) : 0.f;
+
+    for(int l=firstRow; l<=lastRow; l++) {
+        double y = grid.getCoordinate2D(Pixel2D(Minimum.i, l)).y;
+        int first = Minimum.i;
+        int last = Maximum.i;
+
+        // Clip the row against each edge's crossing. The estimate is widened
+        // by one pixel and then settled exactly with the edge functions below.
+        for(int e=0; e<3 && first<=last; e++) {
+            double slopeE = edges[e].getSlopeX();
+            if(slopeE == 0.) {
+                if(!edges[e].contains(Coordinate2D(gridMinimum.x, y)))
+                    first = last + 1;
+                continue;
+            }
+            if(slope.x == 0.)
+                continue;
+            double index = (edges[e].getCrossingX(y) - gridMinimum.x)/slope.x;
+            if(slopeE > 0.) {
+                double lower = std::floor(index) - 1.;
+                if(lower > double(first))
+                    first = lower > double(last) ? last + 1 : int(lower);
+            }
+            else {
+                double upper = std::ceil(index) + 1.;
+                if(upper < double(last))
+                    last = upper < double(first) ? first - 1 : int(upper);
+            }
+        }
+
+        while(first <= last) {
+            Coordinate2D p = grid.getCoordinate2D(Pixel2D(first, l));
+            if(edges[0].contains(p) && edges[1].contains(p) && edges[2].contains(p))
+                break;
+            first++;
+        }
+        while(last > first) {
+            Coordinate2D p = grid.getCoordinate2D(Pixel2D(last, l));
+            if(edges[0].contains(p) && edges[1].contains(p) && edges[2].contains(p))
+                break;
+            last--;
+        }
+        if(first > last)
+            continue;
+
+        double zStart;
+        int offset;
+        if(heightMode == RowSteppedHeight) {
+            zStart = cornerHeight + double(l-Minimum.j)*rowStep;
+            offset = Minimum.i;
+        }
+        else {
+            zStart = Face.getHeight(grid.getCoordinate2D(Pixel2D(first, l)));
+            offset = first;
+        }
+        int fillFirst = qMax(first, ClipMinimum.i);
+        int fillLast = qMin(last, ClipMaximum.i);
+        if(fillFirst > fillLast)
+            continue;
+        Covered += fillLast - fillFirst + 1;
+        double *row = grid.getWritableRow(l) + fillFirst - windowMinimum.i;
+        if(hasLayers) {
+            int column = fillFirst - windowMinimum.i;
+            int *owners = fillOwnedSpan ? grid.getWritableOwnerRow(l) + column : nullptr;
+            double *bottoms = grid.getWritableBottomRow(l);
+            int *counts = grid.getWritableCountRow(l);
+            float *slopes = grid.getWritableSlopeRow(l);
+            Writes += SpanKernel::fillLayers(row, owners, bottoms ? bottoms + column : nullptr, counts ? counts + column : nullptr,
+                                             slopes ? slopes + column : nullptr, fillLast - fillFirst + 1,
+                                             zStart, dz, fillFirst - offset, Owner, faceSlope);
+        }
+        else if(fillOwnedSpan) {
+            int *owners = grid.getWritableOwnerRow(l) + fillFirst - windowMinimum.i;
+            Writes += fillOwnedSpan(row, owners, fillLast - fillFirst + 1, zStart, dz, fillFirst - offset, Owner);
+        }
+        else
+            Writes += fillSpan(row, fillLast - fillFirst + 1, zStart, dz, fillFirst - offset);
+    }
+}
+
+void Wavefront::rasterizeFaceByCrossingTest(WavefrontObject &Object, WavefrontFace &Face, int Owner, Grid &grid,
+                                            Pixel2D Minimum, Pixel2D Maximum, Pixel2D ClipMinimum, Pixel2D ClipMaximum,
+                                            qint64 &Covered, qint64 &Writes)
+{
+    Coordinate3D oldVertex, newVertex;
+    bool hasLayers = grid.hasLayers();
+    float faceSlope = hasLayers ? float(Face.getSlopeAngle()) : 0.f;
+    int column = grid.getWindowMinimum().i;
+    for(int k=qMax(Minimum.i, ClipMinimum.i); k<=qMin(Maximum.i, ClipMaximum.i); k++) {
+        for(int l=qMax(Minimum.j, ClipMinimum.j); l<=qMin(Maximum.j, ClipMaximum.j); l++) {
+            oldVertex = grid.getCoordinate3D(Pixel2D(k,l));
+            if(Object.isPointInPolygon(Face, Coordinate2D(oldVertex.x,oldVertex.y))) {
+                Covered++;
+                newVertex = Object.getHeight(Face, Coordinate2D(oldVertex.x,oldVertex.y));
+                if(hasLayers) {
+                    double *bottoms = grid.getWritableBottomRow(l);
+                    int *counts = grid.getWritableCountRow(l);
+                    if(bottoms && newVertex.z < bottoms[k-column])
+                        bottoms[k-column] = newVertex.z;
+                    if(counts)
+                        counts[k-column]++;
+                }
+                if(newVertex.z > oldVertex.z || !oldVertex.isValid) {
+                    grid.setValue(Pixel2D(k,l), newVertex.z);
+                    if(grid.hasOwners())
+                        grid.setOwner(Pixel2D(k,l), Owner);
+                    float *slopes = hasLayers ? grid.getWritableSlopeRow(l) : nullptr;
+                    if(slopes)
+                        slopes[k-column] = faceSlope;
+                    Writes++;
+                }
+            }
+        }
+    }
+}
+
+double Wavefront::getWidth()
+{
+    Coordinate2D max = getMaximum();
+    Coordinate2D min = getMinimum();
+
+    return max.x - min.x;
+}
+
+double Wavefront::getHeight()
+{
+    Coordinate2D max = getMaximum();
+    Coordinate2D min = getMinimum();
+
+    return max.y - min.y;
+}
+
+
+QImage Wavefront::getImage(Grid &grid)
+{
+    int height = grid.getWindowHeight();
+    int width  = grid.getWindowWidth();
+    int top = grid.getWindowMaximum().j;
+    QImage image = QImage(width, height, QImage::Format_Grayscale8);
+
+    double minimum = 0.;
+    double maximum = 0.;
+    grid.getRange(minimum, maximum);
+
+    // Normalization and quantization in one pass, straight into the scanlines.
+    for(int j=grid.getWindowMinimum().j; j<=top; j++)
+        grid.quantizeRow(j, minimum, maximum, image.scanLine(top-j));
+    return image;
+}
+
+void Wavefront::saveImage(QImage Image, QString Filename)
+{
+    Image.save(Filename, "PNG", -1);
+}
+
+bool Wavefront::saveHeatmap(Grid &grid, QString Filename, HeightmapWriter::Format Format)
+{
+    double minimum = 0.;
+    double maximum = 0.;
+    grid.getRange(minimum, maximum);
+
+    QScopedPointer<HeightmapWriter> writer(HeightmapWriter::create(Format));
+    if(!writer || !writer->open(Filename, grid, minimum, maximum))
+        return false;
+    for(int j=grid.getWindowMaximum().j; j>=grid.getWindowMinimum().j; j--) {
+        if(!writer->writeRow(grid, j))
+            return false;
+    }
+    return writer->close();
+}
+
+bool Wavefront::saveChannels(Grid &grid, QString Filename, HeightmapWriter::Format Format)
+{
+    if(!saveHeatmap(grid, Filename, Format))
+        return false;
+    if(grid.getChannels() == Grid::HeightChannel)
+        return true;
+    Grid layer = Grid(grid, grid.getWindowMinimum(), grid.getWindowMinimum());
+    for(int k=1; k<6; k++) {
+        Grid::Channel type = Grid::Channel(1 << k);
+        if(!(grid.getChannels() & type))
+            continue;
+        grid.getChannel(type, layer);
+        if(!saveHeatmap(layer, getChannelFilename(Filename, type), Format))
+            return false;
+    }
+    return true;
+}
+
+QString Wavefront::getChannelFilename(QString Filename, Grid::Channel Type)
+{
+    if(Type == Grid::HeightChannel)
+        return Filename;
+    int dot = Filename.lastIndexOf('.');
+    if(dot <= Filename.lastIndexOf('/'))
+        dot = Filename.size();
+    return Filename.left(dot) + "_" + Grid::getChannelName(Type) + Filename.mid(dot);
+}
+
+bool Wavefront::getHeightAt(Coordinate2D Point, double &Height)
+{
+    return getSpatialIndex()->getHeight(Point, Height);
+}
+
+bool Wavefront::castRayDown(Coordinate3D Origin, Coordinate3D &Hit)
+{
+    return getSpatialIndex()->castRayDown(Origin, Hit);
+}
+
+SpatialIndex *Wavefront::getSpatialIndex()
+{
+    QMutexLocker locker(&spatialIndexMutex);
+    if(!spatialIndex) {
+        spatialIndex.reset(new SpatialIndex());
+        spatialIndex->build(objects);
+    }
+    return spatialIndex.data();
+}
+
+const RenderProgress *Wavefront::getProgress()
+{
+    return &progress;
+}
+
+void Wavefront::setProgressCallback(ProgressCallback Callback)
+{
+    progressCallback = Callback;
+}
+
+void Wavefront::outputProgress(const RenderProgress &Progress)
+{
+    double progress = Progress.getPercentage();
+    int elapsed = int(Progress.getElapsed()/1000);
+    int remaining = double(elapsed)/double(progress)*(100.-double(progress));
+    if(elapsed == 0 || progress <= 0.) {
+        std::cout << "Progress: " << progress << " %. " <<
+                     "Elapsed: " << elapsed << " s. " << std::endl;
+    }
+    else {
+        std::cout << "Progress: " << progress << " %. " <<
+                     "Elapsed: " << elapsed << " s. " <<
+                     "Remaining: " << remaining << " s." << std::endl;
+    }
+}
+
+QVector<WavefrontObject> Wavefront::getObjects(QString Filename)
+{
+    if(!objects.isEmpty())
+        return objects;
+
+    if(useCache) {
+        MeshCache cache(Filename, cacheDirectory);
+        if(cache.load(objects))
+            return objects;
+        WavefrontReader reader(Filename, loadThreads);
+        objects = reader.read();
+        if(!cache.save(objects) && commandLineOutput)
+            std::cout << "Could not write the mesh cache " << cache.getCacheFilename().toStdString() << "." << std::endl;
+        return objects;
+    }
+
+    WavefrontReader reader(Filename, loadThreads);
+    objects = reader.read();
+    return objects;
+}
+
+qint64 Wavefront::getFaceCount()
+{
+    qint64 count = 0;
+    for(int i=0; i<objects.size(); i++)
+        count += objects[i].faces.size();
+    return count;
+}
+
+int Wavefront::getObjectCount()
+{
+    return objects.size();
+}
+
+WavefrontObject Wavefront::getObject(int Index)
+{
+    return objects[Index];
+}
+
+void Wavefront::setObjectActive(int Index, bool IsActive)
+{
+    if(objects[Index].isActive == IsActive)
+        return;
+    objects[Index].isActive = IsActive;
+    QVector<int> newIndices;
+    for(int i=0; i<objects.size(); i++)
+        newIndices.append(i == Index && !IsActive ? -1 : i);
+    updateObjects(newIndices);
+    if(IsActive)
+        pendingObjects.append(Index);
+}
+
+void Wavefront::setObject(int Index, WavefrontObject Object)
+{
+    Object.updateFaces();
+    objects[Index] = Object;
+    QVector<int> newIndices;
+    for(int i=0; i<objects.size(); i++)
+        newIndices.append(i == Index ? -1 : i);
+    updateObjects(newIndices);
+    if(Object.isActive)
+        pendingObjects.append(Index);
+}
+
+int Wavefront::addObject(WavefrontObject Object)
+{
+    Object.updateFaces();
+    QVector<int> newIndices;
+    for(int i=0; i<objects.size(); i++)
+        newIndices.append(i);
+    objects.append(Object);
+    updateObjects(newIndices);
+    if(Object.isActive)
+        pendingObjects.append(objects.size()-1);
+    return objects.size()-1;
+}
+
+void Wavefront::removeObject(int Index)
+{
+    QVector<int> newIndices;
+    for(int i=0; i<objects.size(); i++)
+        newIndices.append(i < Index ? i : (i == Index ? -1 : i-1));
+    objects.remove(Index);
+    updateObjects(newIndices);
+}
+
+// Whether two objects cover the same pixels at the same heights.
+static bool isSameGeometry(const WavefrontObject &A, const WavefrontObject &B)
+{
+    if(A.vertices.size() != B.vertices.size() || A.indices != B.indices || A.faces.size() != B.faces.size())
+        return false;
+    for(int i=0; i<A.vertices.size(); i++) {
+        const Coordinate3D &a = A.vertices[i];
+        const Coordinate3D &b = B.vertices[i];
+        if(a.x != b.x || a.y != b.y || a.z != b.z)
+            return false;
+    }
+    for(int i=0; i<A.faces.size(); i++) {
+        if(A.faces[i].firstIndex != B.faces[i].firstIndex)
+            return false;
+    }
+    return true;
+}
+
+bool Wavefront::reload()
+{
+    if(!QFileInfo(filename).isReadable())
+        return false;
+    QVector<WavefrontObject> previous = objects;
+    objects.clear();
+    getObjects(filename);
+    // A file that is being rewritten may read as empty.
+    if(objects.isEmpty()) {
+        objects = previous;
+        return false;
+    }
+
+    // Every object takes the first unmatched former one of its name.
+    QHash<QString, QVector<int> > previousByName;
+    for(int i=0; i<previous.size(); i++)
+        previousByName[previous[i].name].append(i);
+    QHash<QString, int> matchedByName;
+    QVector<int> newIndices;
+    newIndices.fill(-1, previous.size());
+    QVector<int> drawn;
+    for(int i=0; i<objects.size(); i++) {
+        const QVector<int> candidates = previousByName.value(objects[i].name);
+        int matched = matchedByName.value(objects[i].name, 0);
+        if(matched < candidates.size()) {
+            matchedByName.insert(objects[i].name, matched+1);
+            const WavefrontObject &former = previous[candidates[matched]];
+            objects[i].isActive = former.isActive;
+            if(isSameGeometry(former, objects[i])) {
+                newIndices[candidates[matched]] = i;
+                continue;
+            }
+        }
+        if(objects[i].isActive)
+            drawn.append(i);
+    }
+    updateObjects(newIndices);
+    pendingObjects += drawn;
+    return true;
+}
+
+void Wavefront::updateObjects(const QVector<int> &NewIndices)
+{
+    spatialIndex.reset();
+    updateExtent();
+    if(!incrementalGrid) {
+        pendingObjects.clear();
+        return;
+    }
+
+    QVector<int> pending;
+    for(int i=0; i<pendingObjects.size(); i++) {
+        if(NewIndices[pendingObjects[i]] >= 0)
+            pending.append(NewIndices[pendingObjects[i]]);
+    }
+    pendingObjects = pending;
+
+    Grid &grid = *incrementalGrid;
+    int width = grid.getWindowWidth();
+    for(int j=grid.getWindowMinimum().j; j<=grid.getWindowMaximum().j; j++) {
+        double *row = grid.getWritableRow(j);
+        int *owners = grid.getWritableOwnerRow(j);
+        for(int i=0; i<width; i++) {
+            if(owners[i] < 0)
+                continue;
+            owners[i] = NewIndices[owners[i]];
+            if(owners[i] < 0) {
+                row[i] = emptyHeight;
+                owners[i] = dirtyOwner;
+            }
+        }
+    }
+}
+
+void Wavefront::setIncremental(bool IsIncremental)
+{
+    incremental = IsIncremental;
+    if(!incremental) {
+        incrementalGrid.reset();
+        pendingObjects.clear();
+    }
+}
+
+bool Wavefront::getIncremental()
+{
+    return incremental;
+}
+
+Grid Wavefront::renderIncrementalHeatmap(double Precision, int Threads)
+{
+    // Nothing can be drawn over resolved samples, so supersampled heatmaps
+    // are always rendered in full, and so are further channels.
+    if(sampleCount > 1 || channels != Grid::HeightChannel) {
+        incrementalGrid.reset();
+        pendingObjects.clear();
+        return renderHeatmap(Precision, Threads, false);
+    }
+    bool isKept = incrementalGrid && incrementalPrecision == Precision &&
+            incrementalMinimum.x == getMinimum().x && incrementalMinimum.y == getMinimum().y &&
+            incrementalMaximum.x == getMaximum().x && incrementalMaximum.y == getMaximum().y &&
+            incrementalRasterMode == rasterMode && incrementalHeightMode == heightMode;
+    ProgressReporter reporter(&progress, getProgressCallback());
+    if(!isKept) {
+        incrementalGrid.reset(new Grid(getMinimum(), getMaximum(), Precision));
+        incrementalGrid->enableOwners();
+        incrementalPrecision = Precision;
+        incrementalMinimum = getMinimum();
+        incrementalMaximum = getMaximum();
+        incrementalRasterMode = rasterMode;
+        incrementalHeightMode = heightMode;
+        pendingObjects.clear();
+
+        Grid &grid = *incrementalGrid;
+        QVector<RasterFace> faces = getRasterFaces(grid);
+        startProgress(getNumberOfIterations(grid.getWindowMinimum(), grid.getWindowMaximum(), faces), reporter, false);
+        rasterizeFaces(grid, faces, Threads);
+        return grid;
+    }
+
+    // Tiles with pixels of changed objects are rendered again from all
+    // faces overlapping them. Their other pixels already hold the maximum,
+    // which rasterizing on top keeps.
+    Grid &grid = *incrementalGrid;
+    const int tileSize = 128;
+    Pixel2D windowMinimum = grid.getWindowMinimum();
+    Pixel2D windowMaximum = grid.getWindowMaximum();
+    int tilesX = (windowMaximum.i - windowMinimum.i + tileSize)/tileSize;
+    int tilesY = (windowMaximum.j - windowMinimum.j + tileSize)/tileSize;
+    QVector<bool> isDirty;
+    isDirty.fill(false, tilesX*tilesY);
+    for(int j=windowMinimum.j; j<=windowMaximum.j; j++) {
+        const int *owners = grid.getOwnerRow(j);
+        for(int i=0; i<grid.getWindowWidth(); i++) {
+            if(owners[i] == dirtyOwner)
+                isDirty[(j-windowMinimum.j)/tileSize*tilesX + i/tileSize] = true;
+        }
+    }
+
+    QVector<HeatmapTile> tiles;
+    QVector<RasterFace> binned;
+    qint64 iterations = 0;
+    for(int ty=0; ty<tilesY; ty++) {
+        for(int tx=0; tx<tilesX; tx++) {
+            if(!isDirty[ty*tilesX+tx])
+                continue;
+            HeatmapTile tile;
+            tile.minimum = Pixel2D(windowMinimum.i + tx*tileSize, windowMinimum.j + ty*tileSize);
+            tile.maximum = Pixel2D(qMin(tile.minimum.i + tileSize - 1, windowMaximum.i),
+                                   qMin(tile.minimum.j + tileSize - 1, windowMaximum.j));
+            QVector<RasterFace> faces = getRasterFaces(grid, tile.minimum, tile.maximum);
+            iterations += getNumberOfIterations(tile.minimum, tile.maximum, faces);
+            tile.firstFace = binned.size();
+            tile.faceCount = faces.size();
+            binned += faces;
+            tiles.append(tile);
+        }
+    }
+
+    // Added and changed objects are drawn over everything.
+    QVector<RasterFace> drawn;
+    for(int i=0; i<pendingObjects.size(); i++) {
+        WavefrontObject &object = objects[pendingObjects[i]];
+        for(int j=0; j<object.faces.size(); j++) {
+            RasterFace face;
+            face.object = &object;
+            face.face = &object.faces[j];
+            face.minimum = grid.getFloorPixel(face.face->getMinimum());
+            face.maximum = grid.getCeilPixel(face.face->getMaximum());
+            drawn.append(face);
+        }
+    }
+    pendingObjects.clear();
+    iterations += getNumberOfIterations(windowMinimum, windowMaximum, drawn);
+    startProgress(iterations, reporter, false);
+
+    {
+        ScopedTimer timer(Statistics::RasterTimer);
+        renderTileList(grid, tiles, binned, Threads);
+    }
+    rasterizeFaces(grid, drawn, Threads);
+
+    // What is still dirty is covered by no face any more.
+    for(int j=windowMinimum.j; j<=windowMaximum.j; j++) {
+        int *owners = grid.getWritableOwnerRow(j);
+        for(int i=0; i<grid.getWindowWidth(); i++) {
+            if(owners[i] == dirtyOwner)
+                owners[i] = -1;
+        }
+    }
+    return grid;
+}
+
+Coordinate2D Wavefront::getMinimum()
+{
+    return extentMinimum;
+}
+
+Coordinate2D Wavefront::getMaximum()
+{
+    return extentMaximum;
+}
+
+void Wavefront::updateExtent()
+{
+    ScopedTimer timer(Statistics::BoundsTimer);
+    double maxDouble = 9999999.;
+    extentMinimum = Coordinate2D(maxDouble,maxDouble);
+    extentMaximum = Coordinate2D(-maxDouble,-maxDouble);
+    for(int i=0; i<objects.size(); i++) {
+        if(!objects[i].isActive)
+            continue;
+        const QVector<Coordinate3D> &vertices = objects[i].vertices;
+        for(int j=0; j<vertices.size(); j++) {
+            if(extentMinimum.x > vertices[j].x)
+                extentMinimum.x = vertices[j].x;
+            if(extentMinimum.y > vertices[j].y)
+                extentMinimum.y = vertices[j].y;
+            if(extentMaximum.x < vertices[j].x)
+                extentMaximum.x = vertices[j].x;
+            if(extentMaximum.y < vertices[j].y)
+                extentMaximum.y = vertices[j].y;
+        }
+    }
+}
+
+// Bounding box pixels of all faces within the window, which is what
+// rasterizeFace() reports.
+qint64 Wavefront::getNumberOfIterations(Pixel2D WindowMinimum, Pixel2D WindowMaximum, const QVector<RasterFace> &Faces)
+{
+    ScopedTimer timer(Statistics::CountTimer);
+    qint64 number = 0;
+    for(int i=0; i<Faces.size(); i++) {
+        qint64 columns = qMin(Faces[i].maximum.i, WindowMaximum.i) - qMax(Faces[i].minimum.i, WindowMinimum.i) + 1;
+        qint64 rows = qMin(Faces[i].maximum.j, WindowMaximum.j) - qMax(Faces[i].minimum.j, WindowMinimum.j) + 1;
+        if(columns > 0 && rows > 0)
+            number += columns*rows;
+    }
+    return number*sampleCount;
+}
+
+ProgressCallback Wavefront::getProgressCallback()
+{
+    if(!progressCallback && commandLineOutput)
+        return outputProgress;
+    return progressCallback;
+}
+
+Grid::Grid(Coordinate2D Minimum, Coordinate2D Maximum, double Precision, bool IsAllocated)
+{
+    double lengthX = Maximum.x - Minimum.x;
+    double lengthY = Maximum.y - Minimum.y;
+    height = int(lengthY/Precision);
+    width = int(lengthX/Precision);
+    minimum = Minimum;
+    maximum = Maximum;
+
+
+    if(width == 1)
+        slopeX = 0.;
+    else
+        slopeX = lengthX/double(width-1);
+
+    if(height == 1)
+        slopeY = 0.;
+    else
+        slopeY = lengthY/double(height-1);
+
+    windowMinimum = Pixel2D(0, 0);
+    windowMaximum = Pixel2D(width-1, height-1);
+    windowWidth = width;
+    channels = HeightChannel;
+    if(!IsAllocated)
+        return;
+
+    allocate(width*height, false);
+}
+
+Grid::Grid(Coordinate2D Minimum, Coordinate2D Maximum, int Width, int Height)
+{
+    width = Width;
+    height = Height;
+    minimum = Minimum;
+    maximum = Maximum;
+    slopeX = width > 1 ? (Maximum.x - Minimum.x)/double(width-1) : 0.;
+    slopeY = height > 1 ? (Maximum.y - Minimum.y)/double(height-1) : 0.;
+
+    windowMinimum = Pixel2D(0, 0);
+    windowMaximum = Pixel2D(width-1, height-1);
+    windowWidth = width;
+    channels = HeightChannel;
+
+    allocate(width*height, false);
+}
+
+Grid::Grid(Grid &Parent, Pixel2D Minimum, Pixel2D Maximum)
+{
+    height = Parent.height;
+    width = Parent.width;
+    minimum = Parent.minimum;
+    maximum = Parent.maximum;
+    slopeX = Parent.slopeX;
+    slopeY = Parent.slopeY;
+    windowMinimum = Minimum;
+    windowMaximum = Maximum;
+    windowWidth = Maximum.i - Minimum.i + 1;
+    channels = Parent.channels;
+
+    allocate(windowWidth*(Maximum.j - Minimum.j + 1), Parent.hasOwners());
+}
+
+void Grid::setOffset(Grid &Parent, Coordinate2D Offset)
+{
+    minimum = Coordinate2D(Parent.minimum.x + Offset.x*slopeX, Parent.minimum.y + Offset.y*slopeY);
+    maximum = Coordinate2D(Parent.maximum.x + Offset.x*slopeX, Parent.maximum.y + Offset.y*slopeY);
+}
+
+void Grid::moveWindow(Pixel2D Minimum, Pixel2D Maximum)
+{
+    windowMinimum = Minimum;
+    windowMaximum = Maximum;
+    windowWidth = Maximum.i - Minimum.i + 1;
+    allocate(windowWidth*(Maximum.j - Minimum.j + 1), hasOwners());
+}
+
+// Clears the buffers to Size pixels; they only grow if they are too small.
+void Grid::allocate(int Size, bool HasOwners)
+{
+    bool hasBottoms = channels & (BottomChannel | ThicknessChannel);
+    bool hasCounts = channels & CountChannel;
+    bool hasSlopes = channels & SlopeChannel;
+    depth.resize(Size);
+    depth.fill(emptyHeight);
+    if(HasOwners) {
+        owners.resize(Size);
+        owners.fill(-1);
+    }
+    if(hasBottoms)
+        bottoms.fill(std::numeric_limits<double>::infinity(), Size);
+    if(hasCounts)
+        counts.fill(0, Size);
+    if(hasSlopes)
+        slopes.fill(0.f, Size);
+}
+
+int Grid::getIndex(Pixel2D Pixel)
+{
+    return (Pixel.j-windowMinimum.j)*windowWidth + Pixel.i-windowMinimum.i;
+}
+
+void Grid::setValue(Pixel2D Pixel, double Value)
+{
+    depth[getIndex(Pixel)] = Value;
+}
+
+void Grid::enableOwners()
+{
+    owners.fill(-1, depth.size());
+}
+
+bool Grid::hasOwners()
+{
+    return !owners.isEmpty();
+}
+
+int Grid::getOwner(Pixel2D Pixel)
+{
+    return hasOwners() ? owners[getIndex(Pixel)] : -1;
+}
+
+void Grid::setOwner(Pixel2D Pixel, int Owner)
+{
+    owners[getIndex(Pixel)] = Owner;
+}
+
+const int *Grid::getOwnerRow(int j)
+{
+    return owners.constData() + (j-windowMinimum.j)*windowWidth;
+}
+
+int *Grid::getWritableOwnerRow(int j)
+{
+    return owners.data() + (j-windowMinimum.j)*windowWidth;
+}
+
+void Grid::enableChannels(int Channels)
+{
+    channels = Channels | HeightChannel;
+    if(channels & ObjectChannel)
+        enableOwners();
+    allocate(depth.size(), hasOwners());
+}
+
+int Grid::getChannels()
+{
+    return channels;
+}
+
+bool Grid::hasLayers()
+{
+    return channels & (BottomChannel | ThicknessChannel | CountChannel | SlopeChannel);
+}
+
+double *Grid::getWritableBottomRow(int j)
+{
+    return bottoms.isEmpty() ? nullptr : bottoms.data() + (j-windowMinimum.j)*windowWidth;
+}
+
+int *Grid::getWritableCountRow(int j)
+{
+    return counts.isEmpty() ? nullptr : counts.data() + (j-windowMinimum.j)*windowWidth;
+}
+
+float *Grid::getWritableSlopeRow(int j)
+{
+    return slopes.isEmpty() ? nullptr : slopes.data() + (j-windowMinimum.j)*windowWidth;
+}
+
+void Grid::getChannel(Channel Type, Grid &Target)
+{
+    if(Target.channels != HeightChannel || Target.hasOwners()) {
+        Target.channels = HeightChannel;
+        Target.owners.clear();
+        Target.bottoms.clear();
+        Target.counts.clear();
+        Target.slopes.clear();
+    }
+    Target.moveWindow(windowMinimum, windowMaximum);
+    double *target = Target.depth.data();
+    for(int i=0; i<depth.size(); i++) {
+        if(!(depth[i] > emptyHeight))
+            continue;
+        switch(Type) {
+        case BottomChannel:
+            target[i] = bottoms[i];
+            break;
+        case CountChannel:
+            target[i] = double(counts[i]);
+            break;
+        case ThicknessChannel:
+            target[i] = depth[i] - bottoms[i];
+            break;
+        case ObjectChannel:
+            target[i] = double(owners[i]);
+            break;
+        case SlopeChannel:
+            target[i] = double(slopes[i]);
+            break;
+        default:
+            target[i] = depth[i];
+        }
+    }
+}
+
+static const char *const channelNames[] = {"height", "bottom", "count", "thickness", "object", "slope"};
+
+Grid::Channel Grid::getChannelType(QString Name)
+{
+    for(int k=0; k<6; k++) {
+        if(Name == channelNames[k])
+            return Channel(1 << k);
+    }
+    return UnknownChannel;
+}
+
+QString Grid::getChannelName(Channel Type)
+{
+    for(int k=0; k<6; k++) {
+        if(Type == (1 << k))
+            return channelNames[k];
+    }
+    return QString();
+}
+
+int Grid::getPixelSize(int Channels)
+{
+    int size = sizeof(double);
+    if(Channels & ~HeightChannel)
+        size += sizeof(double);
+    if(Channels & (BottomChannel | ThicknessChannel))
+        size += sizeof(double);
+    if(Channels & CountChannel)
+        size += sizeof(int);
+    if(Channels & ObjectChannel)
+        size += sizeof(int);
+    if(Channels & SlopeChannel)
+        size += sizeof(float);
+    return size;
+}
+
+Coordinate3D Grid::getCoordinate3D(Pixel2D Pixel)
+{
+    int index = getIndex(Pixel);
+    Coordinate2D c = getCoordinate2D(Pixel);
+    Coordinate3D vertex = Coordinate3D(c.x, c.y, depth[index]);
+    vertex.isValid = depth[index] > emptyHeight;
+    return vertex;
+}
+
+Coordinate2D Grid::getCoordinate2D(Pixel2D Pixel)
+{
+    // Valid outside the window too, tiles rely on that for span setup.
+    return Coordinate2D(minimum.x+double(Pixel.i)*slopeX, minimum.y+double(Pixel.j)*slopeY);
+}
+
+// Last pixel whose coordinate is <= Point, or the first pixel if there is none.
+Pixel2D Grid::getFloorPixel(Coordinate2D Point)
+{
+    return Pixel2D(getFloorIndex(Point.x, minimum.x, slopeX, width),
+                   getFloorIndex(Point.y, minimum.y, slopeY, height));
+}
+
+// First pixel whose coordinate is >= Point, or the last pixel if there is none.
+Pixel2D Grid::getCeilPixel(Coordinate2D Point)
+{
+    return Pixel2D(getCeilIndex(Point.x, minimum.x, slopeX, width),
+                   getCeilIndex(Point.y, minimum.y, slopeY, height));
+}
+
+int Grid::getFloorIndex(double Value, double Minimum, double Slope, int Count)
+{
+    if(Count <= 1 || Slope == 0.)
+        return 0;
+    // The division only estimates the index, the loops settle it against the
+    // exact pixel coordinates Minimum + i*Slope.
+    double estimate = std::floor((Value - Minimum)/Slope);
+    int index = estimate > 0. ? (estimate < double(Count-1) ? int(estimate) : Count-1) : 0;
+    while(index > 0 && Minimum + double(index)*Slope > Value)
+        index--;
+    while(index+1 < Count && Minimum + double(index+1)*Slope <= Value)
+        index++;
+    return index;
+}
+
+int Grid::getCeilIndex(double Value, double Minimum, double Slope, int Count)
+{
+    if(Count <= 1 || Slope == 0.)
+        return Count-1 > 0 ? Count-1 : 0;
+    double estimate = std::ceil((Value - Minimum)/Slope);
+    int index = estimate > 0. ? (estimate < double(Count-1) ? int(estimate) : Count-1) : 0;
+    while(index+1 < Count && Minimum + double(index)*Slope < Value)
+        index++;
+    while(index > 0 && Minimum + double(index-1)*Slope >= Value)
+        index--;
+    return index;
+}
+
+int Grid::getHeight()
+{
+    return height;
+}
+
+int Grid::getWidth()
+{
+    return width;
+}
+
+Coordinate2D Grid::getMinimum()
+{
+    return minimum;
+}
+
+Coordinate2D Grid::getSlope()
+{
+    return Coordinate2D(slopeX, slopeY);
+}
+
+Pixel2D Grid::getWindowMinimum()
+{
+    return windowMinimum;
+}
+
+Pixel2D Grid::getWindowMaximum()
+{
+    return windowMaximum;
+}
+
+int Grid::getWindowWidth()
+{
+    return windowWidth;
+}
+
+int Grid::getWindowHeight()
+{
+    return windowMaximum.j - windowMinimum.j + 1;
+}
+
+const double *Grid::getRow(int j)
+{
+    return depth.constData() + (j-windowMinimum.j)*windowWidth;
+}
+
+double *Grid::getWritableRow(int j)
+{
+    return depth.data() + (j-windowMinimum.j)*windowWidth;
+}
+
+bool Grid::isValid(Pixel2D Pixel)
+{
+    return depth[getIndex(Pixel)] > emptyHeight;
+}
+
+// Branch-free so the compiler can vectorize it; the clamp takes empty pixels
+// at minus infinity to 0.
+template<typename T>
+static void quantizeValues(const double *z, int Count, double Minimum, double Maximum, double Scale, T *Target)
+{
+    double delta = Maximum - Minimum;
+    if(!(delta > 0.)) {
+        std::fill(Target, Target+Count, T(0));
+        return;
+    }
+
+    for(int i=0; i<Count; i++) {
+        double value = (z[i] - Minimum)/delta*Scale;
+        value = value < 0. ? 0. : (value > Scale ? Scale : value);
+        Target[i] = T(int(value));
+    }
+}
+
+void Grid::quantizeRow(int j, double Minimum, double Maximum, uchar *Target)
+{
+    ScopedTimer timer(Statistics::NormalizeTimer);
+    quantizeValues(getRow(j), windowWidth, Minimum, Maximum, 255., Target);
+}
+
+void Grid::quantizeRow(int j, double Minimum, double Maximum, quint16 *Target)
+{
+    ScopedTimer timer(Statistics::NormalizeTimer);
+    quantizeValues(getRow(j), windowWidth, Minimum, Maximum, 65535., Target);
+}
+
+void Grid::getHeightRow(int j, float *Target)
+{
+    ScopedTimer timer(Statistics::NormalizeTimer);
+    const double *z = getRow(j);
+    for(int i=0; i<windowWidth; i++)
+        Target[i] = z[i] > emptyHeight ? float(z[i]) : std::numeric_limits<float>::quiet_NaN();
+}
+
+bool Grid::getRange(double &Minimum, double &Maximum)
+{
+    ScopedTimer timer(Statistics::NormalizeTimer);
+    bool isFound = false;
+    const double *z = depth.constData();
+    for(int i=0; i<depth.size(); i++) {
+        if(!(z[i] > emptyHeight))
+            continue;
+        if(!isFound || Minimum > z[i])
+            Minimum = z[i];
+        if(!isFound || Maximum < z[i])
+            Maximum = z[i];
+        isFound = true;
+    }
+    return isFound;
+}
+
+void Grid::normalize()
+{
+    double globalMax = -99999.;
+    double globalMin = 99999.;
+    for(int i=0; i<depth.size(); i++) {
+        if(!(depth[i] > emptyHeight))
+            continue;
+        if(globalMax < depth[i])
+            globalMax = depth[i];
+        if(globalMin > depth[i])
+            globalMin = depth[i];
+    }
+
+    double delta = globalMax - globalMin;
+
+    double *z = depth.data();
+    for(int i=0; i<depth.size(); i++) {
+        if(z[i] > emptyHeight)
+            z[i] = (z[i] - globalMin)/delta;
+    }
+}
+
+HeatmapTileWorker::HeatmapTileWorker(Wavefront *Owner, Grid *Target, const QVector<HeatmapTile> *Tiles,
+                                     const RasterFace *Faces, QAtomicInt *NextTile, QSemaphore *Finished)
+{
+    owner = Owner;
+    target = Target;
+    tiles = Tiles;
+    faces = Faces;
+    nextTile = NextTile;
+    finished = Finished;
+    setAutoDelete(false);
+}
+
+void HeatmapTileWorker::run()
+{
+    for(int t=nextTile->fetchAndAddRelaxed(1); t<tiles->size(); t=nextTile->fetchAndAddRelaxed(1)) {
+        const HeatmapTile &tile = tiles->at(t);
+        if(owner->sampleCount > 1) {
+            int pixels = (tile.maximum.i - tile.minimum.i + 1)*(tile.maximum.j - tile.minimum.j + 1);
+            if(!sample)
+                sample.reset(new Grid(*target, tile.minimum, tile.maximum));
+            if(counts.size() < pixels)
+                counts.fill(0, pixels);
+            AllocationScope allocations;
+            owner->rasterizeSamples(*target, tile, faces, *sample, counts.data());
+            continue;
+        }
+        AllocationScope allocations;
+        const RasterFace *face = faces + tile.firstFace;
+        for(int i=0; i<tile.faceCount; i++, face++)
+            owner->rasterizeFace(*face->object, *face->face, *target, face->minimum, face->maximum, tile.minimum, tile.maximum);
+    }
+    if(finished)
+        finished->release();
+}
+
+PyramidTile::PyramidTile(Wavefront *Owner, QString Filename, Coordinate2D Minimum, Coordinate2D Maximum, int Size,
+                         HeightmapWriter::Format Format, double HeightMinimum, double HeightMaximum)
+{
+    owner = Owner;
+    filename = Filename;
+    minimum = Minimum;
+    maximum = Maximum;
+    size = Size;
+    format = Format;
+    heightMinimum = HeightMinimum;
+    heightMaximum = HeightMaximum;
+    result = Pending;
+    setAutoDelete(false);
+}
+
+void PyramidTile::addFace(WavefrontObject *Object, WavefrontFace *Face)
+{
+    RasterFace face;
+    face.object = Object;
+    face.face = Face;
+    faces.append(face);
+}
+
+PyramidTile::Result PyramidTile::getResult()
+{
+    return result;
+}
+
+void PyramidTile::run()
+{
+    Grid tile = Grid(minimum, maximum, size, size);
+    for(int i=0; i<faces.size(); i++) {
+        faces[i].minimum = tile.getFloorPixel(faces[i].face->getMinimum());
+        faces[i].maximum = tile.getCeilPixel(faces[i].face->getMaximum());
+    }
+    owner->rasterizeFaces(tile, faces, 1);
+
+    // Faces whose boxes overlap the tile may still miss every pixel.
+    double tileMinimum, tileMaximum;
+    if(!tile.getRange(tileMinimum, tileMaximum)) {
+        result = Empty;
+        return;
+    }
+
+    // The column's directory is only made for tiles that are written.
+    if(!QDir().mkpath(QFileInfo(filename).path())) {
+        result = Failed;
+        return;
+    }
+    QScopedPointer<HeightmapWriter> writer(HeightmapWriter::create(format));
+    bool isWritten = writer->open(filename, tile, heightMinimum, heightMaximum);
+    for(int j=size-1; j>=0 && isWritten; j--)
+        isWritten = writer->writeRow(tile, j);
+    isWritten = writer->close() && isWritten;
+    result = isWritten ? Written : Failed;
+}
+
 Pixel2D::Pixel2D()
 {
     i = j = 0;
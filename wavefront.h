@@ -12,9 +12,20 @@
 #include <QColor>
 #include <QDateTime>
 #include <iostream>
-#include <QTimer>
-#include <QObject>
+#include <cmath>
+#include <algorithm>
 #include <QCoreApplication>
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QAtomicInt>
+#include <QSemaphore>
+#include <QDir>
+#include <QScopedPointer>
+#include <limits>
+
+#include "progress.h"
+#include "heightmapwriter.h"
 
 class Coordinate3D
 {
@@ -67,19 +78,75 @@ public:
 };
 
 
+// A triangle of a WavefrontObject, polygons are split at load time. Its
+// corners are the entries [firstIndex, firstIndex+3) of the object's index
+// buffer, which in turn point into the object's vertex pool.
 class WavefrontFace
 {
 public:
     WavefrontFace();
 
+    // Bounding box in the xy plane, cached by WavefrontObject::updateBounds().
     Coordinate2D getMinimum();
     Coordinate2D getMaximum();
 
-    bool isPointInPolygon(Coordinate2D);
-    Coordinate3D getHeight(Coordinate2D Point);
+    // Height of the face's plane above Point, see WavefrontObject::updatePlane().
+    double getHeight(Coordinate2D Point) const;
+    // Change of the height per unit of x and y.
+    Coordinate2D getPlaneSlope() const;
+    // Angle of the plane to the xy plane in degrees.
+    double getSlopeAngle() const;
 
-    QVector<Coordinate3D> vertices;
-    Coordinate3D normal;
+    int firstIndex;
+    static const int vertexCount = 3;
+    // Index into the object's normal pool, -1 if there is none. Only kept
+    // for the file's sake, heights come from the corners.
+    int normal;
+
+private:
+    friend class WavefrontObject;
+    friend class MeshCache;
+
+    Coordinate2D minimum, maximum;
+    // z = planeHeight + planeSlope.x*(x-minimum.x) + planeSlope.y*(y-minimum.y)
+    Coordinate2D planeSlope;
+    double planeHeight;
+};
+
+
+/* Edge function of a directed triangle edge P->Q: E(X) = cross(Q-P, X-P).
+ * E is positive left of the edge, so a counter-clockwise triangle covers the
+ * points where all three of its edge functions are positive.
+ *
+ * Fill rule: a sample lying exactly on an edge (E == 0) belongs to the
+ * triangle only if the edge is a left or bottom edge. For a counter-clockwise
+ * triangle these are the edges running towards -y (dy < 0), which have the
+ * interior on their +x side, and the horizontal edges running towards +x
+ * (dy == 0, dx > 0), which have it above them in y. Image rows run towards
+ * smaller y, so the latter are bottom edges in the image as well. Two
+ * triangles sharing an edge traverse it in opposite directions, so exactly
+ * one of them owns the samples on it.
+ * E is always evaluated from the lexicographically smaller endpoint and
+ * negated when needed, so the shared edge yields bit-identical values of
+ * opposite sign in both triangles and the rule is exact, not just nominal. */
+class TriangleEdge
+{
+public:
+    TriangleEdge(Coordinate2D P, Coordinate2D Q);
+
+    double evaluate(Coordinate2D Point) const;
+    bool contains(Coordinate2D Point) const;
+
+    // Rate of change of E along +x.
+    double getSlopeX() const;
+    // x where the edge's supporting line crosses the row y (requires dy != 0).
+    double getCrossingX(double Y) const;
+
+private:
+    Coordinate2D origin;
+    Coordinate2D direction;
+    double sign;
+    bool ownsBoundary;
 };
 
 
@@ -87,7 +154,24 @@ class WavefrontObject
 {
 public:
     WavefrontObject();
+
+    Coordinate3D getVertex(const WavefrontFace &Face, int K);
+    Coordinate3D getNormal(const WavefrontFace &Face);
+    void updateBounds(WavefrontFace &Face);
+    // Fits the plane of a face to its corners, through their centroid and
+    // along their Newell normal. Call after updateBounds. Returns false for
+    // faces without a height, i.e. vertical or degenerate ones.
+    bool updatePlane(WavefrontFace &Face);
+    // Bounds and planes of all faces, dropping those without a height.
+    void updateFaces();
+
+    bool isPointInPolygon(const WavefrontFace &Face, Coordinate2D Point);
+    Coordinate3D getHeight(const WavefrontFace &Face, Coordinate2D Point);
+
     QString name;
+    QVector<Coordinate3D> vertices;
+    QVector<Coordinate3D> normals;
+    QVector<int> indices;
     QVector<WavefrontFace> faces;
     bool isActive;
 };
@@ -96,10 +180,69 @@ public:
 class Grid
 {
 public:
-    Grid(Coordinate2D Minimum, Coordinate2D Maximum, double Precision);
+    // What a render can keep for every pixel, all collected in the same
+    // pass over the faces. The height is always kept.
+    enum Channel {
+        UnknownChannel = 0,
+        HeightChannel = 0x01,    // Height of the highest face, the heatmap itself.
+        BottomChannel = 0x02,    // Height of the lowest face.
+        CountChannel = 0x04,     // Number of faces covering the pixel.
+        ThicknessChannel = 0x08, // Highest minus lowest height.
+        ObjectChannel = 0x10,    // Index of the object of the highest face.
+        SlopeChannel = 0x20      // Steepness of the highest face in degrees.
+    };
+
+    // With IsAllocated false the window spans the whole grid but has no
+    // buffer; it only serves as the layout that windows are taken from.
+    Grid(Coordinate2D Minimum, Coordinate2D Maximum, double Precision, bool IsAllocated = true);
+    // Width x Height pixels, the first at Minimum and the last at Maximum.
+    Grid(Coordinate2D Minimum, Coordinate2D Maximum, int Width, int Height);
+    // Depth buffer for the window [Minimum, Maximum] of Parent. Pixels keep
+    // the parent's indices and coordinates.
+    Grid(Grid &Parent, Pixel2D Minimum, Pixel2D Maximum);
+    // Moves the window to [Minimum, Maximum] of the same grid and clears
+    // it. The buffer is only reallocated if the window outgrows it.
+    void moveWindow(Pixel2D Minimum, Pixel2D Maximum);
+    // Places every pixel Offset pixels away from the same pixel of Parent,
+    // whose layout the grid shares, e.g. onto one sample of a pixel.
+    void setOffset(Grid &Parent, Coordinate2D Offset);
 
     void setValue(Pixel2D Pixel, double Value);
 
+    // Index of the object that set each pixel of the window, -1 where no
+    // face did. Only kept after enableOwners(), which has to come before
+    // rendering; windows taken from such a grid keep owners as well.
+    void enableOwners();
+    bool hasOwners();
+    int getOwner(Pixel2D Pixel);
+    void setOwner(Pixel2D Pixel, int Owner);
+    const int *getOwnerRow(int j);
+    int *getWritableOwnerRow(int j);
+
+    // Keeps the buffers Channels need besides the heights; the object
+    // channel keeps owners. Has to come before rendering, windows taken from
+    // the grid keep the same channels.
+    void enableChannels(int Channels);
+    int getChannels();
+    // Whether faces have to fill more than heights and owners.
+    bool hasLayers();
+    // Rows of the window, null for buffers that are not kept. Bottoms of
+    // pixels without a face are plus infinity.
+    double *getWritableBottomRow(int j);
+    int *getWritableCountRow(int j);
+    float *getWritableSlopeRow(int j);
+    // Turns Target, which shares this grid's layout, into plain heights on
+    // the same window and sets them to the values of Type. Pixels without
+    // a face stay empty.
+    void getChannel(Channel Type, Grid &Target);
+    // Names as used by --channels: height, bottom, count, thickness, object
+    // and slope.
+    static Channel getChannelType(QString Name);
+    static QString getChannelName(Channel Type);
+    // Bytes a pixel takes with Channels, including the copy that a channel
+    // other than the height is written from.
+    static int getPixelSize(int Channels);
+
     Coordinate3D getCoordinate3D(Pixel2D Pixel);
     Coordinate2D getCoordinate2D(Pixel2D Pixel);
 
@@ -109,41 +252,288 @@ public:
     int getHeight();
     int getWidth();
 
+    Coordinate2D getMinimum();
+    Coordinate2D getSlope();
+    Pixel2D getWindowMinimum();
+    Pixel2D getWindowMaximum();
+    int getWindowWidth();
+    int getWindowHeight();
+
+    // Heights of row j within the window, and whether a pixel has been set.
+    const double *getRow(int j);
+    double *getWritableRow(int j);
+    bool isValid(Pixel2D Pixel);
+    // Range of the valid heights. Returns false if no pixel is valid.
+    bool getRange(double &Minimum, double &Maximum);
+    // Maps row j of the window from [Minimum, Maximum] onto 0..255 (or
+    // 0..65535), invalid pixels become 0. Target needs room for the window's
+    // width.
+    void quantizeRow(int j, double Minimum, double Maximum, uchar *Target);
+    void quantizeRow(int j, double Minimum, double Maximum, quint16 *Target);
+    // Row j of the window as float heights, NaN where no pixel was set.
+    void getHeightRow(int j, float *Target);
+
     void normalize();
 
 private:
-    struct GridPoint {
-        Coordinate3D c;
-        Pixel2D p;
-    };
-
-    QVector<QVector<Coordinate3D>> pixels;
-    QVector<QVector<GridPoint>> grid;
+    int getIndex(Pixel2D Pixel);
+    void allocate(int Size, bool HasOwners);
+    static int getFloorIndex(double Value, double Minimum, double Slope, int Count);
+    static int getCeilIndex(double Value, double Minimum, double Slope, int Count);
+
+    // Heights of the window, row by row. Pixels without a face hold minus
+    // infinity, which every height is above, so that filling a row is a
+    // plain compare and store. x and y follow from minimum and the slopes
+    // and are not stored.
+    QVector<double> depth;
+    // Same layout as depth, empty without owners.
+    QVector<int> owners;
+    // Same layout as depth, each empty unless a channel needs it.
+    int channels;
+    QVector<double> bottoms;
+    QVector<int> counts;
+    QVector<float> slopes;
+    int windowWidth;
     int width;
     int height;
     Coordinate2D minimum, maximum;
+    double slopeX, slopeY;
+    Pixel2D windowMinimum, windowMaximum;
+};
+
+
+class Wavefront;
+class SpatialIndex;
+class HeatmapJob;
+class HeatmapJobTask;
+
+// A face together with its bounding box in pixels.
+struct RasterFace {
+    WavefrontObject *object;
+    WavefrontFace *face;
+    Pixel2D minimum;
+    Pixel2D maximum;
+};
+
+// A rectangle of the heatmap together with the faces whose bounding boxes
+// overlap it, [firstFace, firstFace+faceCount) of a list shared by all
+// tiles. Tiles do not overlap, so they are rasterized side by side
+// straight into the heatmap.
+struct HeatmapTile {
+    Pixel2D minimum;
+    Pixel2D maximum;
+    int firstFace;
+    int faceCount;
+};
+
+// Rasterizes the tiles of a render one after the other, always taking the
+// next one that no other worker took yet. One worker runs per thread.
+// Finished, if given, is released once the worker is done with the render,
+// which may then be gone before the worker is deleted.
+class HeatmapTileWorker : public QRunnable
+{
+public:
+    HeatmapTileWorker(Wavefront *Owner, Grid *Target, const QVector<HeatmapTile> *Tiles, const RasterFace *Faces,
+                      QAtomicInt *NextTile, QSemaphore *Finished = nullptr);
+
+    void run();
+
+private:
+    Wavefront *owner;
+    Grid *target;
+    const QVector<HeatmapTile> *tiles;
+    const RasterFace *faces;
+    QAtomicInt *nextTile;
+    QSemaphore *finished;
+    // Scratch of a supersampled render, reused for every tile.
+    QScopedPointer<Grid> sample;
+    QVector<int> counts;
+};
+
+
+// One tile of a z/x/y pyramid, rendered into its own grid from the faces
+// overlapping it and written straight to its file.
+class PyramidTile : public QRunnable
+{
+public:
+    enum Result {
+        Pending,
+        Written,
+        Empty, // No pixel covered, no file written.
+        Failed
+    };
+
+    // Heights in [HeightMinimum, HeightMaximum] are mapped onto the output
+    // values, the same for all tiles.
+    PyramidTile(Wavefront *Owner, QString Filename, Coordinate2D Minimum, Coordinate2D Maximum, int Size,
+                HeightmapWriter::Format Format, double HeightMinimum, double HeightMaximum);
+
+    void addFace(WavefrontObject *Object, WavefrontFace *Face);
+    Result getResult();
+
+    void run();
+
+private:
+    Wavefront *owner;
+    QString filename;
+    Coordinate2D minimum, maximum;
+    int size;
+    HeightmapWriter::Format format;
+    double heightMinimum, heightMaximum;
+    QVector<RasterFace> faces;
+    Result result;
 };
 
 
-class Wavefront : public QObject
+class Wavefront
 {
-    Q_OBJECT
 public:
-    Wavefront(QString Filename, bool commandLineOutput);
+    enum RasterMode {
+        EdgeFunctionRaster, // Scanline walk over triangle edge functions (default).
+        CrossingTestRaster  // Per-pixel isPointInPolygon over the bounding box (reference).
+    };
+
+    // How the edge rasterizer gets the height at the start of a span.
+    enum HeightMode {
+        PlaneHeight,     // Evaluates the face's plane for every row (default).
+        RowSteppedHeight // Steps from the face's bottom left pixel by a fixed amount per row.
+    };
+
+    // Where the samples of a supersampled pixel lie.
+    enum SamplePattern {
+        RotatedGridSamples, // One per row and column of a 16x16 grid, for 2, 4, 8 or 16 samples (default).
+        StratifiedSamples   // One per cell of a k x k grid, at a fixed position within the cell, for k*k samples.
+    };
+
+    // How the samples of a pixel make up its height. Samples not covered by
+    // any face are left out; a pixel without any covered sample stays empty.
+    enum ResolveFilter {
+        MaximumResolve, // The highest sample (default).
+        MeanResolve,    // The mean of the covered samples.
+        MinimumResolve  // The lowest covered sample.
+    };
+
+    // With UseCache the parsed mesh is kept in a binary cache, see MeshCache,
+    // next to the obj file or in CacheDirectory, and reloaded from there as
+    // long as the obj file is unchanged. The obj file is parsed on
+    // LoadThreads threads, 0 uses all cores.
+    Wavefront(QString Filename, bool commandLineOutput, bool UseCache = false, QString CacheDirectory = QString(),
+              int LoadThreads = 0);
 
     ~Wavefront();
 
+    void setRasterMode(RasterMode Mode);
+    RasterMode getRasterMode();
+    void setHeightMode(HeightMode Mode);
+    HeightMode getHeightMode();
+    // Samples every pixel Count times instead of once at its centre and
+    // resolves them tile by tile, so no image larger than the output is
+    // kept. Unsupported combinations, see isValidSampling, are ignored.
+    void setSampling(int Count, SamplePattern Pattern = RotatedGridSamples);
+    static bool isValidSampling(int Count, SamplePattern Pattern);
+    int getSampleCount();
+    SamplePattern getSamplePattern();
+    void setResolveFilter(ResolveFilter Filter);
+    ResolveFilter getResolveFilter();
+    // Channels, see Grid::Channel, that the heatmaps of getHeatmap, the jobs
+    // and saveStripedHeatmap hold besides the heights. They are filled in
+    // the same pass over the faces. Supersampled renders and pyramids only
+    // keep the heights.
+    void setChannels(int Channels);
+    int getChannels();
+
+    // Number of worker threads for getHeatmap. 1 renders serially,
+    // 0 uses one thread per core.
+    void setThreadCount(int Count);
+    int getThreadCount();
+
     Grid getHeatmap(double Precision);
+    // Pixel pitch giving about PixelCount pixels for the whole mesh.
+    double getPrecision(qint64 PixelCount);
+    // Renders only the pixels of the full heatmap at Precision that lie within
+    // [Minimum, Maximum], at least one. The result is a window of that
+    // heatmap, with identical pixel values, and only the faces overlapping it
+    // are visited.
+    Grid getHeatmap(double Precision, Coordinate2D Minimum, Coordinate2D Maximum);
     double getWidth();
     double getHeight();
+    qint64 getFaceCount();
 
-    QImage getImage(Grid grid);
+    QImage getImage(Grid &grid);
     void saveImage(QImage Image, QString Filename);
-
-public slots:
-    void outputProgress();
+    // Streams the heatmap to a file row by row, without a QImage.
+    bool saveHeatmap(Grid &grid, QString Filename, HeightmapWriter::Format Format = HeightmapWriter::Png8Format);
+    // Writes the heights to Filename like saveHeatmap and every further
+    // channel of grid to its own file, see getChannelFilename.
+    bool saveChannels(Grid &grid, QString Filename, HeightmapWriter::Format Format = HeightmapWriter::Png8Format);
+    // out.png -> out_bottom.png; the height keeps Filename.
+    static QString getChannelFilename(QString Filename, Grid::Channel Type);
+    // Writes an XYZ tile pyramid below Directory as <zoom>/<x>/<y>.<suffix>
+    // for all zoom levels in [MinimumZoom, MaximumZoom]. Zoom 0 is a single
+    // square tile covering [Minimum, Maximum]; every level splits each tile
+    // in four, y counts from the top. Tiles without faces are skipped, the
+    // others are rendered in parallel and share one height range. Levels
+    // are rendered one after the other, a few tiles at a time.
+    bool savePyramid(QString Directory, int MinimumZoom, int MaximumZoom, Coordinate2D Minimum, Coordinate2D Maximum,
+                     HeightmapWriter::Format Format = HeightmapWriter::Png8Format);
+    bool savePyramid(QString Directory, int MinimumZoom, int MaximumZoom,
+                     HeightmapWriter::Format Format = HeightmapWriter::Png8Format);
+    // Renders and writes all jobs from the one parsed mesh, several at a
+    // time. Returns false if any job failed, see HeatmapJob::isWritten.
+    bool renderBatch(QVector<HeatmapJob> &Jobs);
+    // Renders and writes the heatmap in horizontal bands from the top row
+    // down, so that the depth buffer never exceeds MaxMemory bytes no matter
+    // how large the output is. Normalized formats need the height range up
+    // front and render every band twice. Further channels are written the
+    // same way, each to its own file. Fails if a single row needs more than
+    // MaxMemory.
+    bool saveStripedHeatmap(double Precision, QString Filename, HeightmapWriter::Format Format, qint64 MaxMemory);
+
+    // The objects of the mesh. Inactive ones are neither rendered nor found
+    // by point queries. None of the changes below may run during a render.
+    int getObjectCount();
+    WavefrontObject getObject(int Index);
+    void setObjectActive(int Index, bool IsActive);
+    // Replaces the geometry of an object. Bounds and planes of the faces
+    // are computed here.
+    void setObject(int Index, WavefrontObject Object);
+    int addObject(WavefrontObject Object);
+    void removeObject(int Index);
+    // Reads the obj file again. Objects are matched by name in file order;
+    // matched ones keep whether they are active. False if the file cannot
+    // be read or holds no objects, the objects stay as they were then.
+    bool reload();
+
+    // With incremental rendering getHeatmap(Precision) keeps its depth
+    // buffer and the owner of every pixel. After objects were added,
+    // removed, toggled or changed, the next call at the same precision only
+    // renders again the tiles of pixels owned by changed objects and then
+    // draws the new objects on top. The heatmap is the same as that of a
+    // full render; a change of the mesh extent or of the raster or height
+    // mode still renders everything, as does every supersampled render and
+    // every render with further channels.
+    void setIncremental(bool IsIncremental);
+    bool getIncremental();
+
+    // Point queries through the spatial index, see SpatialIndex.
+    bool getHeightAt(Coordinate2D Point, double &Height);
+    bool castRayDown(Coordinate3D Origin, Coordinate3D &Hit);
+    // Built on first use.
+    SpatialIndex *getSpatialIndex();
+
+    // Progress of the running getHeatmap. It can be polled from any thread,
+    // or pushed once per second to a callback set here. With command line
+    // output enabled and no callback, the progress is printed to stdout.
+    const RenderProgress *getProgress();
+    void setProgressCallback(ProgressCallback Callback);
+    static void outputProgress(const RenderProgress &Progress);
 
 private:
+    friend class HeatmapTileWorker;
+    friend class PyramidTile;
+    friend class HeatmapJobTask;
+    friend class RenderServer;
+
     QString filename;
 
     QVector<WavefrontObject> objects;
@@ -151,17 +541,100 @@ private:
 
     // Methods
     QVector<WavefrontObject> getObjects(QString Filename);
+    bool useCache;
+    QString cacheDirectory;
+    int loadThreads;
     Coordinate2D getMinimum();
     Coordinate2D getMaximum();
-
-    int getNumberOfIterations(Grid);
+    // Extent of all vertices of active objects, computed after loading and
+    // after every change of the objects.
+    void updateExtent();
+    // Drops what depends on the objects after they changed. NewIndices
+    // holds the new index of every former object, -1 for those removed or
+    // changed, whose pixels of the kept heatmap are cleared.
+    void updateObjects(const QVector<int> &NewIndices);
+    Coordinate2D extentMinimum, extentMaximum;
+
+    qint64 getNumberOfIterations(Pixel2D WindowMinimum, Pixel2D WindowMaximum, const QVector<RasterFace> &Faces);
+    ProgressCallback getProgressCallback();
     bool commandLineOutput;
 
-    QTimer *timer;
-    int totalNumberOfIterations;
-    int iteration;
-    QDateTime timeStart;
-
+    // The render paths behind the public calls. Threads is the tile thread
+    // count; a batch job leaves the progress to the batch.
+    Grid renderHeatmap(double Precision, int Threads, bool IsBatchJob);
+    Grid renderHeatmap(double Precision, Coordinate2D Minimum, Coordinate2D Maximum, int Threads, bool IsBatchJob);
+    bool renderStripedHeatmap(double Precision, QString Filename, HeightmapWriter::Format Format, qint64 MaxMemory,
+                              int Threads, bool IsBatchJob);
+    bool renderJob(HeatmapJob &Job, int Threads);
+    double getJobPrecision(HeatmapJob &Job);
+    qint64 getJobIterations(HeatmapJob &Job);
+    void startProgress(qint64 Total, ProgressReporter &Reporter, bool IsBatchJob);
+
+    void rasterizeFace(WavefrontObject &Object, WavefrontFace &Face, Grid &grid, Pixel2D Minimum, Pixel2D Maximum);
+    // Only writes the pixels within [ClipMinimum, ClipMaximum], which has to
+    // lie within the grid's window.
+    void rasterizeFace(WavefrontObject &Object, WavefrontFace &Face, Grid &grid, Pixel2D Minimum, Pixel2D Maximum,
+                       Pixel2D ClipMinimum, Pixel2D ClipMaximum);
+    // Both add the pixels found inside the face to Covered and the depth
+    // buffer writes to Writes. Grids with owners get Owner for the pixels
+    // written.
+    void rasterizeTriangle(Coordinate2D A, Coordinate2D B, Coordinate2D C, const WavefrontFace &Face, int Owner,
+                           Grid &grid, Pixel2D Minimum, Pixel2D Maximum, Pixel2D ClipMinimum, Pixel2D ClipMaximum,
+                           qint64 &Covered, qint64 &Writes);
+    void rasterizeFaceByCrossingTest(WavefrontObject &Object, WavefrontFace &Face, int Owner, Grid &grid,
+                                     Pixel2D Minimum, Pixel2D Maximum, Pixel2D ClipMinimum, Pixel2D ClipMaximum,
+                                     qint64 &Covered, qint64 &Writes);
+    RasterMode rasterMode;
+    HeightMode heightMode;
+    int sampleCount;
+    SamplePattern samplePattern;
+    ResolveFilter resolveFilter;
+    int channels;
+    // The channels a render keeps with the current settings.
+    int getRenderChannels();
+    // Offsets of the samples from the pixel centre, in pixels.
+    QVector<Coordinate2D> sampleOffsets;
+    // How far the samples reach from the pixel centre, in pixels.
+    Coordinate2D getSampleReach();
+    // Rasterizes all samples of a tile into Sample, a grid of the tile's
+    // size, and resolves them into grid. Counts has room for the tile's
+    // pixels. The tile's pixels in grid have to be empty.
+    void rasterizeSamples(Grid &grid, const HeatmapTile &Tile, const RasterFace *Faces, Grid &Sample, int *Counts);
+
+    QVector<RasterFace> getRasterFaces(Grid &grid);
+    QVector<RasterFace> getRasterFaces(Grid &grid, Pixel2D WindowMinimum, Pixel2D WindowMaximum);
+    void getCropWindow(Grid &Layout, Coordinate2D Minimum, Coordinate2D Maximum, Pixel2D &WindowMinimum, Pixel2D &WindowMaximum);
+    void rasterizeFaces(Grid &grid, const QVector<RasterFace> &Faces, int Threads);
+    void rasterizeFaces(Grid &grid, const RasterFace *Faces, int Count, int Threads);
+    void renderTiles(Grid &grid, const RasterFace *Faces, int Count, int Threads);
+    // Faces holds the faces of all tiles. 1 thread renders them right here.
+    void renderTileList(Grid &grid, const QVector<HeatmapTile> &Tiles, const QVector<RasterFace> &Faces, int Threads);
+    // Runs the tile workers of all renders where set, instead of a pool
+    // per render. Owned by the RenderServer.
+    QThreadPool *tilePool;
+    // Rows per band, 0 if a single row does not fit into MaxMemory.
+    int getBandHeight(Grid &grid, qint64 MaxMemory);
+    int threadCount;
+
+    RenderProgress progress;
+    ProgressCallback progressCallback;
+
+    QScopedPointer<SpatialIndex> spatialIndex;
+    QMutex spatialIndexMutex;
+
+    // The heatmap kept for incremental rendering and what it was made with.
+    Grid renderIncrementalHeatmap(double Precision, int Threads);
+    bool incremental;
+    QScopedPointer<Grid> incrementalGrid;
+    double incrementalPrecision;
+    Coordinate2D incrementalMinimum, incrementalMaximum;
+    RasterMode incrementalRasterMode;
+    HeightMode incrementalHeightMode;
+    // Objects to draw over the kept heatmap on the next render.
+    QVector<int> pendingObjects;
+
+    // Waits for a batch of pyramid tiles and frees them. False if any failed.
+    bool finishPyramidTiles(QThreadPool &Pool, QVector<PyramidTile*> &Tiles);
 };
 
 #endif // WAVEFRONT_H
@@ -0,0 +1,34 @@
+# Rendering core shared by the command line tool, the benchmark and the
+# static library.
+
+INCLUDEPATH += $$PWD
+
+SOURCES += \
+    $$PWD/wavefront.cpp \
+    $$PWD/progress.cpp \
+    $$PWD/heightmapwriter.cpp \
+    $$PWD/wavefrontreader.cpp \
+    $$PWD/spatialindex.cpp \
+    $$PWD/meshcache.cpp \
+    $$PWD/heatmapjob.cpp \
+    $$PWD/statistics.cpp \
+    $$PWD/rasterkernel.cpp \
+    $$PWD/renderserver.cpp
+
+HEADERS += \
+    $$PWD/wavefront.h \
+    $$PWD/progress.h \
+    $$PWD/heightmapwriter.h \
+    $$PWD/wavefrontreader.h \
+    $$PWD/spatialindex.h \
+    $$PWD/meshcache.h \
+    $$PWD/heatmapjob.h \
+    $$PWD/statistics.h \
+    $$PWD/rasterkernel.h \
+    $$PWD/renderserver.h
+
+# Streaming PNG output.
+LIBS += -lpng
+
+# The span kernels must not differ from the scalar one by FMA contraction.
+*-g++*|*-clang*: QMAKE_CXXFLAGS += -ffp-contract=off
@@ -0,0 +1,553 @@
+#include "wavefrontreader.h"
+#include "statistics.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QVarLengthArray>
+#include <charconv>
+#include <cstring>
+#include <algorithm>
+#include <limits>
+
+const char *WavefrontReader::defaultName = "default";
+
+WavefrontReader::WavefrontReader(QString Filename, int Threads)
+{
+    filename = Filename;
+    threads = Threads > 0 ? Threads : qMax(QThread::idealThreadCount(), 1);
+    bytesRead = 0;
+}
+
+QVector<WavefrontObject> WavefrontReader::read()
+{
+    ScopedTimer timer(Statistics::ParseTimer);
+    QFile file(filename);
+    if(!file.open(QIODevice::ReadOnly))
+        return objects;
+
+    qint64 size = file.size();
+    uchar *data = size > 0 ? file.map(0, size) : nullptr;
+    if(data) {
+        const char *begin = reinterpret_cast<const char*>(data);
+        splitChunks(begin, begin + size);
+        if(chunks.size() > 1) {
+            // Every chunk starts where the ones before it left off.
+            runStep(CountStep, chunks.size());
+            int totals[2] = {0, 0};
+            bool hasNamedObject = false;
+            for(int i=0; i<chunks.size(); i++) {
+                for(int kind=0; kind<2; kind++) {
+                    chunks[i].totals[kind] = totals[kind];
+                    totals[kind] += chunks[i].counts[kind];
+                }
+                chunks[i].hasNamedObject = hasNamedObject;
+                hasNamedObject = hasNamedObject || chunks[i].hasObjectLine;
+            }
+        }
+        runStep(ParseStep, chunks.size());
+        bytesRead = size;
+        file.unmap(data);
+    }
+    else {
+        // Streaming fallback: parse every complete line in the buffer and
+        // carry the incomplete tail over to the next read.
+        chunks.resize(1);
+        startChunk(chunks[0], true);
+        QByteArray buffer;
+        buffer.resize(bufferSize);
+        int filled = 0;
+        for(;;) {
+            qint64 count = file.read(buffer.data() + filled, buffer.size() - filled);
+            if(count <= 0) {
+                parseLines(chunks[0], buffer.constData(), buffer.constData() + filled);
+                break;
+            }
+            bytesRead += count;
+            filled += int(count);
+
+            const char *begin = buffer.constData();
+            const char *end = begin + filled;
+            const char *lastNewline = end;
+            while(lastNewline > begin && lastNewline[-1] != '\n')
+                lastNewline--;
+            if(lastNewline == begin) {
+                if(filled == buffer.size())
+                    buffer.resize(buffer.size()*2); // A single line longer than the buffer.
+                continue;
+            }
+            parseLines(chunks[0], begin, lastNewline);
+            int remainder = int(end - lastNewline);
+            std::memmove(buffer.data(), lastNewline, size_t(remainder));
+            filled = remainder;
+        }
+    }
+    file.close();
+
+    assembleObjects();
+    finishObjects();
+    Statistics::add(Statistics::BytesReadCounter, bytesRead);
+    return objects;
+}
+
+qint64 WavefrontReader::getBytesRead()
+{
+    return bytesRead;
+}
+
+void WavefrontReader::runStep(Step Type, int Count)
+{
+    if(threads == 1 || Count == 1) {
+        for(int i=0; i<Count; i++)
+            run(Type, i);
+        return;
+    }
+
+    QVector<WavefrontReaderTask*> tasks;
+    QThreadPool pool;
+    pool.setMaxThreadCount(threads);
+    for(int i=0; i<Count; i++) {
+        tasks.append(new WavefrontReaderTask(this, Type, i));
+        pool.start(tasks.last());
+    }
+    pool.waitForDone();
+    qDeleteAll(tasks);
+}
+
+void WavefrontReader::run(Step Type, int Index)
+{
+    switch(Type) {
+    case CountStep:
+        countLines(chunks.data()[Index]);
+        break;
+    case ParseStep: {
+        Chunk &chunk = chunks.data()[Index];
+        parseLines(chunk, chunk.begin, chunk.end);
+        break;
+    }
+    case TranslateStep:
+        translateIndices(ranges.data()[Index]);
+        break;
+    case BorrowStep:
+        borrowIndices(Index);
+        break;
+    case PlaneStep:
+        updatePlanes(ranges.data()[Index]);
+        break;
+    }
+}
+
+void WavefrontReader::splitChunks(const char *Begin, const char *End)
+{
+    // A few chunks per thread even out chunks that take longer than others.
+    qint64 size = End - Begin;
+    int count = int(qBound(qint64(1), size/minimumChunkSize, qint64(threads)*4));
+    if(threads == 1)
+        count = 1;
+    chunks.resize(count);
+    const char *begin = Begin;
+    for(int i=0; i<count; i++) {
+        const char *end = End;
+        if(i+1 < count) {
+            end = qMax(begin, Begin + size*(i+1)/count);
+            const char *newline = static_cast<const char*>(std::memchr(end, '\n', size_t(End - end)));
+            end = newline ? newline + 1 : End;
+        }
+        chunks[i].begin = begin;
+        chunks[i].end = end;
+        startChunk(chunks[i], i == 0);
+        begin = end;
+    }
+}
+
+void WavefrontReader::startChunk(Chunk &chunk, bool IsFirst)
+{
+    chunk.counts[0] = chunk.counts[1] = 0;
+    chunk.hasObjectLine = false;
+    chunk.totals[0] = chunk.totals[1] = 0;
+    chunk.hasNamedObject = false;
+
+    // Only the file's first chunk starts an object, the default one.
+    Piece piece;
+    piece.isStart = IsFirst;
+    piece.isDefault = IsFirst;
+    if(IsFirst)
+        piece.object.name = defaultName;
+    chunk.pieces.clear();
+    chunk.pieces.append(piece);
+}
+
+// Has to see the same lines as parseLine() does.
+void WavefrontReader::countLines(Chunk &chunk)
+{
+    const char *line = chunk.begin;
+    while(line < chunk.end) {
+        const char *newline = static_cast<const char*>(std::memchr(line, '\n', size_t(chunk.end - line)));
+        const char *lineEnd = newline ? newline : chunk.end;
+        const char *position = skipSpaces(line, lineEnd);
+        int identifierLength = int(skipToken(position, lineEnd) - position);
+        if(identifierLength == 1 && position[0] == 'v')
+            chunk.counts[0]++;
+        else if(identifierLength == 2 && position[0] == 'v' && position[1] == 'n')
+            chunk.counts[1]++;
+        else if(identifierLength == 1 && position[0] == 'o')
+            chunk.hasObjectLine = true;
+        line = lineEnd + 1;
+    }
+}
+
+void WavefrontReader::parseLines(Chunk &chunk, const char *Begin, const char *End)
+{
+    const char *line = Begin;
+    while(line < End) {
+        const char *newline = static_cast<const char*>(std::memchr(line, '\n', size_t(End - line)));
+        const char *lineEnd = newline ? newline : End;
+        parseLine(chunk, line, lineEnd);
+        line = lineEnd + 1;
+    }
+}
+
+void WavefrontReader::parseLine(Chunk &chunk, const char *Begin, const char *End)
+{
+    const char *position = skipSpaces(Begin, End);
+    const char *identifierEnd = skipToken(position, End);
+    int identifierLength = int(identifierEnd - position);
+    if(identifierLength == 0)
+        return;
+
+    // Groups only start an object in files without "o" lines, within an
+    // object they are material or smoothing groups of it.
+    bool isObject = identifierLength == 1 && position[0] == 'o';
+    bool isGroup = identifierLength == 1 && position[0] == 'g';
+    if(isObject || (isGroup && !chunk.hasNamedObject)) {
+        Piece piece;
+        const char *name = skipSpaces(identifierEnd, End);
+        piece.object.name = QString::fromUtf8(name, int(skipToken(name, End) - name));
+        piece.isStart = true;
+        piece.isDefault = false;
+        chunk.pieces.append(piece);
+        chunk.hasNamedObject = chunk.hasNamedObject || isObject;
+        return;
+    }
+
+    WavefrontObject &object = chunk.pieces.last().object;
+    if((identifierLength == 1 && position[0] == 'v') ||
+       (identifierLength == 2 && position[0] == 'v' && position[1] == 'n')) {
+        position = identifierEnd;
+        double x, y, z;
+        if(!parseDouble(position, End, x) || !parseDouble(position, End, y) || !parseDouble(position, End, z))
+            x = y = z = std::numeric_limits<double>::quiet_NaN();
+        if(identifierLength == 1) {
+            object.vertices.append(Coordinate3D(x, y, z));
+            chunk.totals[0]++;
+        }
+        else {
+            object.normals.append(Coordinate3D(x, y, z));
+            chunk.totals[1]++;
+        }
+    }
+    else if(identifierLength == 1 && position[0] == 'f') {
+        // Corners are v, v/vt, v//vn or v/vt/vn. Texture coordinates are not
+        // needed and only skipped.
+        QVarLengthArray<int, 16> corners;
+        WavefrontFace face = WavefrontFace();
+        position = identifierEnd;
+        for(;;) {
+            position = skipSpaces(position, End);
+            if(position >= End)
+                break;
+            int vertex = 0;
+            int texture = 0;
+            int normal = 0;
+            int global;
+            bool isValid = parseInt(position, End, vertex);
+            if(isValid && position < End && *position == '/') {
+                position++;
+                if(position < End && *position != '/')
+                    parseInt(position, End, texture);
+                if(position < End && *position == '/') {
+                    position++;
+                    parseInt(position, End, normal);
+                }
+            }
+            position = skipToken(position, End);
+            if(!isValid || !getGlobalIndex(vertex, chunk.totals[0], global))
+                return;
+            corners.append(global);
+            if(corners.size() == 1 && normal != 0 && getGlobalIndex(normal, chunk.totals[1], global))
+                face.normal = global;
+        }
+
+        // Polygons become a fan of triangles around their first corner.
+        for(int k=1; k+1<corners.size(); k++) {
+            face.firstIndex = object.indices.size();
+            object.indices.append(corners[0]);
+            object.indices.append(corners[k]);
+            object.indices.append(corners[k+1]);
+            object.faces.append(face);
+        }
+    }
+}
+
+bool WavefrontReader::getGlobalIndex(int Index, int Total, int &Global)
+{
+    // Negative indices count back from the last one declared so far.
+    Global = Index < 0 ? Total + Index : Index - 1;
+    return Global >= 0 && Global < Total;
+}
+
+void WavefrontReader::assembleObjects()
+{
+    // The pieces of every object, in file order.
+    QVector<QVector<const Piece*> > parts;
+    for(int i=0; i<chunks.size(); i++) {
+        for(int j=0; j<chunks[i].pieces.size(); j++) {
+            const Piece &piece = chunks[i].pieces.at(j);
+            if(piece.isStart)
+                parts.append(QVector<const Piece*>());
+            parts.last().append(&piece);
+        }
+    }
+
+    int totals[2] = {0, 0};
+    for(int i=0; i<parts.size(); i++) {
+        const QVector<const Piece*> &part = parts.at(i);
+        // An object within one chunk is shared rather than copied.
+        WavefrontObject object = part.first()->object;
+        if(part.size() > 1) {
+            int vertexCount = 0, normalCount = 0, indexCount = 0, faceCount = 0;
+            for(int j=0; j<part.size(); j++) {
+                vertexCount += part[j]->object.vertices.size();
+                normalCount += part[j]->object.normals.size();
+                indexCount += part[j]->object.indices.size();
+                faceCount += part[j]->object.faces.size();
+            }
+            object.vertices.reserve(vertexCount);
+            object.normals.reserve(normalCount);
+            object.indices.reserve(indexCount);
+            object.faces.reserve(faceCount);
+            for(int j=1; j<part.size(); j++) {
+                const WavefrontObject &source = part[j]->object;
+                int offset = object.indices.size();
+                object.vertices += source.vertices;
+                object.normals += source.normals;
+                object.indices += source.indices;
+                for(int k=0; k<source.faces.size(); k++) {
+                    WavefrontFace face = source.faces[k];
+                    face.firstIndex += offset;
+                    object.faces.append(face);
+                }
+            }
+        }
+
+        // The default object only counts if anything was declared in it.
+        if(part.first()->isDefault && object.vertices.isEmpty() && object.normals.isEmpty())
+            continue;
+        int declared[2] = {object.vertices.size(), object.normals.size()};
+        for(int kind=0; kind<2; kind++) {
+            bases[kind].append(totals[kind]);
+            counts[kind].append(declared[kind]);
+            totals[kind] += declared[kind];
+        }
+        objects.append(object);
+    }
+    // Leaves the objects' data unshared, to be changed in place.
+    chunks.clear();
+}
+
+void WavefrontReader::finishObjects()
+{
+    for(int i=0; i<objects.size(); i++) {
+        firstRanges.append(ranges.size());
+        for(int first=0; first<objects[i].faces.size(); first+=facesPerRange) {
+            FaceRange range;
+            range.object = i;
+            range.first = first;
+            range.count = qMin(objects[i].faces.size() - first, int(facesPerRange));
+            range.hasForeignIndices = false;
+            range.verticalFaces = 0;
+            ranges.append(range);
+        }
+    }
+    firstRanges.append(ranges.size());
+
+    runStep(TranslateStep, ranges.size());
+
+    bool hasForeignIndices = false;
+    for(int i=0; i<ranges.size(); i++)
+        hasForeignIndices = hasForeignIndices || ranges[i].hasForeignIndices;
+    if(hasForeignIndices) {
+        for(int kind=0; kind<2; kind++)
+            borrowed[kind].resize(objects.size());
+        runStep(BorrowStep, objects.size());
+        for(int i=0; i<objects.size(); i++) {
+            objects[i].vertices += borrowed[0][i];
+            objects[i].normals += borrowed[1][i];
+        }
+        borrowed[0].clear();
+        borrowed[1].clear();
+    }
+
+    runStep(PlaneStep, ranges.size());
+    for(int i=0; i<objects.size(); i++) {
+        int verticalFaces = 0;
+        for(int j=firstRanges[i]; j<firstRanges[i+1]; j++)
+            verticalFaces += ranges[j].verticalFaces;
+        if(verticalFaces > 0)
+            removeVerticalFaces(i);
+    }
+    ranges.clear();
+    firstRanges.clear();
+}
+
+// Indices into other objects' pools are kept as -2 - global until
+// borrowIndices(); -1 is left free as the face's "no normal".
+void WavefrontReader::translateIndices(FaceRange &Range)
+{
+    WavefrontObject &object = objects.data()[Range.object];
+    int base[2] = {bases[0].at(Range.object), bases[1].at(Range.object)};
+    int count[2] = {counts[0].at(Range.object), counts[1].at(Range.object)};
+    int *indices = object.indices.data();
+    WavefrontFace *faces = object.faces.data();
+    for(int i=Range.first; i<Range.first+Range.count; i++) {
+        int *corner = indices + faces[i].firstIndex;
+        for(int k=0; k<WavefrontFace::vertexCount; k++) {
+            int local = corner[k] - base[0];
+            if(local >= 0 && local < count[0])
+                corner[k] = local;
+            else {
+                corner[k] = -2 - corner[k];
+                Range.hasForeignIndices = true;
+            }
+        }
+        if(faces[i].normal >= 0) {
+            int local = faces[i].normal - base[1];
+            if(local >= 0 && local < count[1])
+                faces[i].normal = local;
+            else {
+                faces[i].normal = -2 - faces[i].normal;
+                Range.hasForeignIndices = true;
+            }
+        }
+    }
+}
+
+void WavefrontReader::borrowIndices(int Object)
+{
+    // Numbered in the order of the faces, as a sequential read would.
+    QHash<int, int> poolIndices[2];
+    WavefrontObject &object = objects.data()[Object];
+    int *indices = object.indices.data();
+    WavefrontFace *faces = object.faces.data();
+    for(int j=firstRanges.at(Object); j<firstRanges.at(Object+1); j++) {
+        const FaceRange &range = ranges.at(j);
+        if(!range.hasForeignIndices)
+            continue;
+        for(int i=range.first; i<range.first+range.count; i++) {
+            int *corner = indices + faces[i].firstIndex;
+            for(int k=0; k<WavefrontFace::vertexCount; k++) {
+                if(corner[k] < 0)
+                    corner[k] = getBorrowedIndex(Object, 0, -2 - corner[k], poolIndices[0]);
+            }
+            if(faces[i].normal < -1)
+                faces[i].normal = getBorrowedIndex(Object, 1, -2 - faces[i].normal, poolIndices[1]);
+        }
+    }
+}
+
+int WavefrontReader::getBorrowedIndex(int Object, int Kind, int Global, QHash<int, int> &PoolIndices)
+{
+    if(PoolIndices.contains(Global))
+        return PoolIndices.value(Global);
+
+    // Declared by an earlier object, find it by its base.
+    int owner = int(std::upper_bound(bases[Kind].constBegin(), bases[Kind].constEnd(), Global) - bases[Kind].constBegin()) - 1;
+    const WavefrontObject &source = objects.at(owner);
+    int sourceIndex = Global - bases[Kind].at(owner);
+    QVector<Coordinate3D> &pool = borrowed[Kind].data()[Object];
+    int poolIndex = counts[Kind].at(Object) + pool.size();
+    pool.append(Kind == 0 ? source.vertices.at(sourceIndex) : source.normals.at(sourceIndex));
+    PoolIndices.insert(Global, poolIndex);
+    return poolIndex;
+}
+
+// Faces without a height are marked by a firstIndex of -1, to be dropped by
+// removeVerticalFaces().
+void WavefrontReader::updatePlanes(FaceRange &Range)
+{
+    WavefrontObject &object = objects.data()[Range.object];
+    WavefrontFace *faces = object.faces.data();
+    for(int i=Range.first; i<Range.first+Range.count; i++) {
+        object.updateBounds(faces[i]);
+        if(!object.updatePlane(faces[i])) {
+            faces[i].firstIndex = -1;
+            Range.verticalFaces++;
+        }
+    }
+}
+
+// Dropped here, once, instead of being skipped on every render.
+void WavefrontReader::removeVerticalFaces(int Object)
+{
+    WavefrontObject &object = objects[Object];
+    int count = 0;
+    for(int i=0; i<object.faces.size(); i++) {
+        if(object.faces[i].firstIndex >= 0)
+            object.faces[count++] = object.faces[i];
+    }
+    object.faces.resize(count);
+}
+
+bool WavefrontReader::isSpace(char Character)
+{
+    return Character == ' ' || Character == '\t' || Character == '\r';
+}
+
+const char *WavefrontReader::skipSpaces(const char *Position, const char *End)
+{
+    while(Position < End && isSpace(*Position))
+        Position++;
+    return Position;
+}
+
+const char *WavefrontReader::skipToken(const char *Position, const char *End)
+{
+    while(Position < End && !isSpace(*Position))
+        Position++;
+    return Position;
+}
+
+bool WavefrontReader::parseDouble(const char *&Position, const char *End, double &Value)
+{
+    Position = skipSpaces(Position, End);
+    if(Position < End && *Position == '+')
+        Position++;
+    std::from_chars_result result = std::from_chars(Position, End, Value);
+    if(result.ec != std::errc())
+        return false;
+    Position = result.ptr;
+    return true;
+}
+
+bool WavefrontReader::parseInt(const char *&Position, const char *End, int &Value)
+{
+    if(Position < End && *Position == '+')
+        Position++;
+    std::from_chars_result result = std::from_chars(Position, End, Value);
+    if(result.ec != std::errc())
+        return false;
+    Position = result.ptr;
+    return true;
+}
+
+WavefrontReaderTask::WavefrontReaderTask(WavefrontReader *Owner, WavefrontReader::Step Type, int Index)
+{
+    owner = Owner;
+    type = Type;
+    index = Index;
+    setAutoDelete(false);
+}
+
+void WavefrontReaderTask::run()
+{
+    owner->run(type, index);
+}
@@ -0,0 +1,146 @@
+#ifndef WAVEFRONTREADER_H
+#define WAVEFRONTREADER_H
+
+#include <QString>
+#include <QVector>
+#include <QFile>
+#include <QHash>
+#include <QRunnable>
+
+#include "wavefront.h"
+
+// Parses a Wavefront obj file straight from its bytes. The file is memory
+// mapped when possible, otherwise it is read through a fixed-size buffer.
+// Both paths tokenize in place and convert numbers with std::from_chars, so
+// no per-line or per-token strings are allocated.
+//
+// Faces are split into triangles while parsing, corners may be given as v,
+// v/vt, v//vn or v/vt/vn and indices may be negative, i.e. relative to the
+// end of the pool. Geometry ahead of the first "o" line goes to an object
+// named "default"; in files without "o" lines, every "g" group becomes an
+// object. A malformed "v" or "vn" line still takes up its index, as NaN, so
+// that the indices after it stay as in the file; faces using it are dropped.
+//
+// Every object gets its own vertex and normal pool. The file's global,
+// 1-based indices are translated into pool indices. The rare reference to
+// an earlier object's vertex copies that vertex over once, to the end of
+// the pool.
+//
+// A mapped file is split at line ends into chunks that are parsed side by
+// side. A first pass counts the "v" and "vn" lines of every chunk, so each
+// chunk knows the global indices it starts at; the pieces of objects found
+// in the chunks are then put together in file order and the indices of
+// every object are translated in ranges of faces, again side by side. The
+// result does not depend on the number of threads.
+class WavefrontReader
+{
+public:
+    // 0 uses one thread per core.
+    WavefrontReader(QString Filename, int Threads = 0);
+
+    QVector<WavefrontObject> read();
+    qint64 getBytesRead();
+
+private:
+    friend class WavefrontReaderTask;
+
+    // The part of one object that lies within a chunk. Its indices are
+    // global and 0-based.
+    struct Piece {
+        WavefrontObject object;
+        bool isStart;   // Starts an object rather than continuing the one before.
+        bool isDefault; // The object ahead of the first "o" or "g" line.
+    };
+
+    struct Chunk {
+        const char *begin;
+        const char *end;
+        // "v" and "vn" lines, and whether there is an "o" line.
+        int counts[2];
+        bool hasObjectLine;
+        // Vertices and normals declared ahead of the chunk, while parsing
+        // ahead of the current line.
+        int totals[2];
+        // Whether an "o" line came before, after which "g" lines only group.
+        bool hasNamedObject;
+        QVector<Piece> pieces;
+    };
+
+    struct FaceRange {
+        int object;
+        int first;
+        int count;
+        bool hasForeignIndices;
+        int verticalFaces;
+    };
+
+    enum Step {
+        CountStep,     // countLines per chunk.
+        ParseStep,     // parseLines per chunk.
+        TranslateStep, // translateIndices per face range.
+        BorrowStep,    // borrowIndices per object.
+        PlaneStep      // updatePlanes per face range.
+    };
+    void runStep(Step Type, int Count);
+    void run(Step Type, int Index);
+
+    void splitChunks(const char *Begin, const char *End);
+    static void startChunk(Chunk &chunk, bool IsFirst);
+    static void countLines(Chunk &chunk);
+    static void parseLines(Chunk &chunk, const char *Begin, const char *End);
+    static void parseLine(Chunk &chunk, const char *Begin, const char *End);
+    static bool getGlobalIndex(int Index, int Total, int &Global);
+
+    void assembleObjects();
+    void finishObjects();
+    void translateIndices(FaceRange &Range);
+    void borrowIndices(int Object);
+    int getBorrowedIndex(int Object, int Kind, int Global, QHash<int, int> &PoolIndices);
+    void updatePlanes(FaceRange &Range);
+    void removeVerticalFaces(int Object);
+
+    static bool isSpace(char Character);
+    static const char *skipSpaces(const char *Position, const char *End);
+    static const char *skipToken(const char *Position, const char *End);
+    static bool parseDouble(const char *&Position, const char *End, double &Value);
+    static bool parseInt(const char *&Position, const char *End, int &Value);
+
+    static const int bufferSize = 1 << 20;
+    static const qint64 minimumChunkSize = 1 << 20;
+    static const int facesPerRange = 1 << 16;
+    static const char *defaultName;
+
+    QString filename;
+    int threads;
+    qint64 bytesRead;
+
+    QVector<Chunk> chunks;
+    QVector<WavefrontObject> objects;
+    QVector<FaceRange> ranges;
+    // The ranges of object i are [firstRanges[i], firstRanges[i+1]).
+    QVector<int> firstRanges;
+
+    // Global index ranges [base, base+count) declared by every object, in
+    // the order of objects. Index 0 is for vertices, index 1 for normals.
+    QVector<int> bases[2];
+    QVector<int> counts[2];
+    // Copies of other objects' entries per object, appended to its pools.
+    QVector<QVector<Coordinate3D> > borrowed[2];
+};
+
+
+// One step of a read for one chunk, object or range of faces.
+class WavefrontReaderTask : public QRunnable
+{
+public:
+    WavefrontReaderTask(WavefrontReader *Owner, WavefrontReader::Step Type, int Index);
+
+    void run();
+
+private:
+    WavefrontReader *owner;
+    WavefrontReader::Step type;
+    int index;
+};
+
+#endif // WAVEFRONTREADER_H